@@ -68,6 +68,21 @@ ifdef BACKLIGHT_ENABLE
     OPT_DEFS += -DBACKLIGHT_ENABLE
 endif
 
+ifdef TRACE_ENABLE
+    SRC += $(COMMON_DIR)/trace.c
+    OPT_DEFS += -DTRACE_ENABLE
+endif
+
+ifdef HOST_MUX_ENABLE
+    SRC += $(COMMON_DIR)/host_mux.c
+    OPT_DEFS += -DHOST_MUX_ENABLE
+endif
+
+ifdef DYNAMIC_MACRO_ENABLE
+    SRC += $(COMMON_DIR)/dynamic_macro.c
+    OPT_DEFS += -DDYNAMIC_MACRO_ENABLE
+endif
+
 
 # Search Path
 VPATH += $(TOP_DIR)/common
@@ -25,6 +25,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "action_tapping.h"
 #include "action_oneshot.h"
 #include "action_macro.h"
+#include "dynamic_macro.h"
+#include "trace.h"
 #include "action.h"
 
 #ifdef DEBUG_ACTION
@@ -37,6 +39,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 void action_exec(keyevent_t event)
 {
     if (!IS_NOEVENT(event)) {
+        trace2("event: %04X %u", event.key.row<<8 | event.key.col, event.pressed);
         dprint("\n---- action_exec: start -----\n");
         dprint("EVENT: "); debug_event(event); dprintln();
     }
@@ -333,6 +336,10 @@ void process_action(keyrecord_t *record)
  */
 void register_code(uint8_t code)
 {
+#ifdef DYNAMIC_MACRO_ENABLE
+    dynamic_macro_record(code, true);
+#endif
+
     if (code == KC_NO) {
         return;
     }
@@ -405,6 +412,10 @@ void register_code(uint8_t code)
 
 void unregister_code(uint8_t code)
 {
+#ifdef DYNAMIC_MACRO_ENABLE
+    dynamic_macro_record(code, false);
+#endif
+
     if (code == KC_NO) {
         return;
     }
@@ -490,6 +501,8 @@ void clear_keyboard_but_mods(void)
 {
     host_clear_keys();
     host_send_keyboard_report();
+    // callers may wait or switch driver after this
+    host_flush_keyboard_report();
 #ifdef MOUSEKEY_ENABLE
     mousekey_clear();
     mousekey_send();
@@ -14,9 +14,11 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
-#include <util/delay.h>
 #include "action.h"
 #include "action_macro.h"
+#include "host.h"
+#include "keycode.h"
+#include "timer.h"
 
 #ifdef DEBUG_ACTION
 #include "debug.h"
@@ -27,48 +29,300 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #ifndef NO_ACTION_MACRO
 
-#define MACRO_READ()  (macro = pgm_read_byte(macro_p++))
-void action_macro_play(const macro_t *macro_p)
+/* macros waiting to be played */
+static const macro_t *macro_queue[MACRO_QUEUE_SIZE];
+static bool macro_queue_ram[MACRO_QUEUE_SIZE];
+static uint8_t macro_queue_head = 0;
+static uint8_t macro_queue_tail = 0;
+static uint16_t macro_queue_dropped = 0;
+
+/* macro being played */
+static const macro_t *macro_p = 0;
+static bool macro_ram = false;
+static uint8_t macro_interval = 0;
+static uint16_t macro_wait = 0;
+static uint16_t macro_timer = 0;
+
+/* REPEAT */
+static const macro_t *repeat_p = 0;
+static uint8_t repeat_count = 0;
+
+/* STRING and MODS_SEQ */
+static bool string_typing = false;
+static uint8_t string_key = 0;
+static uint8_t string_added = 0;    // mods changed from real ones
+static uint8_t string_removed = 0;
+static bool string_seq = false;     // MODS_SEQ: keycodes instead of ASCII
+static uint8_t seq_mods = 0;
+
+
+/* ASCII to keycode(US layout). bit7 means Shift is needed. */
+#define S(kc)   (0x80 | (kc))
+static const uint8_t ascii_to_keycode[128] PROGMEM = {
+    /* 0x00 */ 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x08 */ KC_BSPC, KC_TAB, KC_ENT, 0, 0, 0, 0, 0,
+    /* 0x10 */ 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x18 */ 0, 0, 0, KC_ESC, 0, 0, 0, 0,
+    /*  !"# */ KC_SPC, S(KC_1), S(KC_QUOT), S(KC_3),
+    /* $%&' */ S(KC_4), S(KC_5), S(KC_7), KC_QUOT,
+    /* ()*+ */ S(KC_9), S(KC_0), S(KC_8), S(KC_EQL),
+    /* ,-./ */ KC_COMM, KC_MINS, KC_DOT, KC_SLSH,
+    /* 0123 */ KC_0, KC_1, KC_2, KC_3,
+    /* 4567 */ KC_4, KC_5, KC_6, KC_7,
+    /* 89:; */ KC_8, KC_9, S(KC_SCLN), KC_SCLN,
+    /* <=>? */ S(KC_COMM), KC_EQL, S(KC_DOT), S(KC_SLSH),
+    /* @ABC */ S(KC_2), S(KC_A), S(KC_B), S(KC_C),
+    /* DEFG */ S(KC_D), S(KC_E), S(KC_F), S(KC_G),
+    /* HIJK */ S(KC_H), S(KC_I), S(KC_J), S(KC_K),
+    /* LMNO */ S(KC_L), S(KC_M), S(KC_N), S(KC_O),
+    /* PQRS */ S(KC_P), S(KC_Q), S(KC_R), S(KC_S),
+    /* TUVW */ S(KC_T), S(KC_U), S(KC_V), S(KC_W),
+    /* XYZ[ */ S(KC_X), S(KC_Y), S(KC_Z), KC_LBRC,
+    /* \]^_ */ KC_BSLS, KC_RBRC, S(KC_6), S(KC_MINS),
+    /* `abc */ KC_GRV, KC_A, KC_B, KC_C,
+    /* defg */ KC_D, KC_E, KC_F, KC_G,
+    /* hijk */ KC_H, KC_I, KC_J, KC_K,
+    /* lmno */ KC_L, KC_M, KC_N, KC_O,
+    /* pqrs */ KC_P, KC_Q, KC_R, KC_S,
+    /* tuvw */ KC_T, KC_U, KC_V, KC_W,
+    /* xyz{ */ KC_X, KC_Y, KC_Z, S(KC_LBRC),
+    /* |}~  */ S(KC_BSLS), S(KC_RBRC), S(KC_GRV), 0
+};
+#undef S
+
+static void string_type(uint8_t c);
+static void repeat_skip(void);
+
+
+static void macro_enqueue(const macro_t *macro, bool ram)
+{
+    if (!macro) return;
+
+    // Playing till there is room would stop matrix scan and USB polling
+    // for as long as WAITs of queued macros.
+    uint8_t next = (macro_queue_head + 1) % MACRO_QUEUE_SIZE;
+    if (next == macro_queue_tail) {
+        dprint("macro_queue: full\n");
+        macro_queue_dropped++;
+        return;
+    }
+    macro_queue[macro_queue_head] = macro;
+    macro_queue_ram[macro_queue_head] = ram;
+    macro_queue_head = next;
+}
+
+/* Queue macro to be played by action_macro_task(). */
+void action_macro_play(const macro_t *macro)
+{
+    macro_enqueue(macro, false);
+}
+
+/* Queue macro in RAM. The buffer must not be changed until it is played. */
+void action_macro_play_ram(const macro_t *macro)
+{
+    macro_enqueue(macro, true);
+}
+
+bool action_macro_is_playing(void)
+{
+    return (macro_p || macro_queue_head != macro_queue_tail);
+}
+
+uint16_t action_macro_dropped(void)
+{
+    return macro_queue_dropped;
+}
+
+#define MACRO_READ()  (macro = (macro_ram ? *macro_p++ : pgm_read_byte(macro_p++)))
+/* Play one macro command per call. This is called repeatedly from keyboard_task(). */
+void action_macro_task(void)
 {
     macro_t macro = END;
-    uint8_t interval = 0;
 
-    if (!macro_p) return;
-    while (true) {
+    if (macro_wait) {
+        if (timer_elapsed(macro_timer) < macro_wait) return;
+        macro_wait = 0;
+    }
+
+    if (!macro_p) {
+        if (macro_queue_head == macro_queue_tail) return;
+        macro_p = macro_queue[macro_queue_tail];
+        macro_ram = macro_queue_ram[macro_queue_tail];
+        macro_queue_tail = (macro_queue_tail + 1) % MACRO_QUEUE_SIZE;
+        macro_interval = 0;
+        repeat_count = 0;
+    }
+
+    if (string_typing) {
+        MACRO_READ();
+        string_type(macro);
+        goto INTERVAL;
+    }
+
+    switch (MACRO_READ()) {
+        case KEY_DOWN:
+            MACRO_READ();
+            dprintf("KEY_DOWN(%02X)\n", macro);
+            register_code(macro);
+            break;
+        case KEY_UP:
+            MACRO_READ();
+            dprintf("KEY_UP(%02X)\n", macro);
+            unregister_code(macro);
+            break;
+        case WAIT:
+            MACRO_READ();
+            dprintf("WAIT(%u)\n", macro);
+            macro_wait = macro;
+            break;
+        case INTERVAL:
+            macro_interval = MACRO_READ();
+            dprintf("INTERVAL(%u)\n", macro_interval);
+            break;
+        case MODS_TYPE:
+            {
+                uint8_t mods = MACRO_READ();
+                MACRO_READ();
+                dprintf("MODS_TYPE(%02X, %02X)\n", mods, macro);
+                // mods and key in a report, and release both in a report
+                uint8_t tmp_mods = host_get_mods();
+                host_add_mods(mods);
+                host_add_key(macro);
+                host_send_keyboard_report();
+                host_del_key(macro);
+                host_set_mods(tmp_mods);
+                host_send_keyboard_report();
+            }
+            break;
+        case STRING:
+        case MODS_SEQ:
+            string_typing = true;
+            string_key = 0;
+            string_added = 0;
+            string_removed = 0;
+            string_seq = (macro == MODS_SEQ);
+            seq_mods = (string_seq ? MACRO_READ() : 0);
+            dprintf("%s(%02X)\n", string_seq ? "MODS_SEQ" : "STRING", seq_mods);
+            // type first charactor right now
+            MACRO_READ();
+            string_type(macro);
+            break;
+        case REPEAT:
+            repeat_count = MACRO_READ();
+            dprintf("REPEAT(%u)\n", repeat_count);
+            repeat_p = macro_p;
+            if (!repeat_count) repeat_skip();
+            break;
+        case REPEAT_END:
+            dprint("REPEAT_END\n");
+            if (repeat_count > 1) {
+                repeat_count--;
+                macro_p = repeat_p;
+            }
+            break;
+        case 0x04 ... 0x73:
+            dprintf("DOWN(%02X)\n", macro);
+            register_code(macro);
+            break;
+        case 0x84 ... 0xF3:
+            dprintf("UP(%02X)\n", macro);
+            unregister_code(macro&0x7F);
+            break;
+        case END:
+        default:
+            macro_p = 0;
+            return;
+    }
+
+INTERVAL:
+    macro_wait += macro_interval;
+    if (macro_wait) {
+        macro_timer = timer_read();
+    }
+}
+
+/* Skip commands till REPEAT_END, or stop at END. */
+static void repeat_skip(void)
+{
+    macro_t macro;
+    while (1) {
         switch (MACRO_READ()) {
             case KEY_DOWN:
-                MACRO_READ();
-                dprintf("KEY_DOWN(%02X)\n", macro);
-                register_code(macro);
-                break;
             case KEY_UP:
+            case WAIT:
+            case INTERVAL:
+            case REPEAT:
                 MACRO_READ();
-                dprintf("KEY_UP(%02X)\n", macro);
-                unregister_code(macro);
                 break;
-            case WAIT:
+            case MODS_TYPE:
+                MACRO_READ();
                 MACRO_READ();
-                dprintf("WAIT(%u)\n", macro);
-                { uint8_t ms = macro; while (ms--) _delay_ms(1); }
                 break;
-            case INTERVAL:
-                interval = MACRO_READ();
-                dprintf("INTERVAL(%u)\n", interval);
+            case MODS_SEQ:
+                MACRO_READ();
+                // fall through
+            case STRING:
+                while (MACRO_READ()) ;
                 break;
+            case REPEAT_END:
+                return;
             case 0x04 ... 0x73:
-                dprintf("DOWN(%02X)\n", macro);
-                register_code(macro);
-                break;
             case 0x84 ... 0xF3:
-                dprintf("UP(%02X)\n", macro);
-                unregister_code(macro&0x7F);
                 break;
             case END:
             default:
+                // let action_macro_task() see END
+                macro_p--;
                 return;
         }
-        // interval
-        { uint8_t ms = interval; while (ms--) _delay_ms(1); }
     }
 }
+
+/* Type a charactor of STRING, or a key of MODS_SEQ. 0 ends the string. */
+static void string_type(uint8_t c)
+{
+    uint8_t key, mods;
+    // real mods may change while typing, keep own changes apart from them
+    uint8_t real = (host_get_mods() | string_removed) & ~string_added;
+
+    if (c == 0) {
+        dprint("STRING: end\n");
+        string_typing = false;
+        if (string_key) host_del_key(string_key);
+        host_set_mods((host_get_mods() | string_removed) & ~string_added);
+        string_added = 0;
+        string_removed = 0;
+        host_send_keyboard_report();
+        return;
+    }
+
+    if (string_seq) {
+        key = c;
+        mods = real | seq_mods;
+    } else {
+        uint8_t code = (c & 0x80) ? 0 : pgm_read_byte(&ascii_to_keycode[c]);
+        key = code & 0x7F;
+        if (code & 0x80) {
+            mods = real | MOD_BIT(KC_LSHIFT);
+        } else {
+            mods = real & ~(MOD_BIT(KC_LSHIFT) | MOD_BIT(KC_RSHIFT));
+        }
+    }
+    if (!key) return;
+
+    // same key in a row needs release in between
+    if (key == string_key) {
+        host_del_key(string_key);
+        host_send_keyboard_report();
+    }
+
+    // release last key and press next one in a report
+    if (string_key) host_del_key(string_key);
+    string_key = key;
+    string_added = mods & ~real;
+    string_removed = real & ~mods;
+    host_set_mods(mods);
+    host_add_key(string_key);
+    host_send_keyboard_report();
+}
 #endif
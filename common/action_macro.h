@@ -17,7 +17,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef ACTION_MACRO_H
 #define ACTION_MACRO_H
 #include <stdint.h>
-#include <avr/pgmspace.h>
+#include <stdbool.h>
+#include "progmem.h"
 
 
 #define MACRO_NONE  0
@@ -26,11 +27,27 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 typedef uint8_t macro_t;
 
+/* number of macros which can wait for playing */
+#ifndef MACRO_QUEUE_SIZE
+#define MACRO_QUEUE_SIZE 4
+#endif
+
 
 #ifndef NO_ACTION_MACRO
+/* Macro is queued and played step by step in action_macro_task()
+ * so that keyboard_task() keeps scanning matrix and polling USB. */
 void action_macro_play(const macro_t *macro_p);
+void action_macro_play_ram(const macro_t *macro_p);
+void action_macro_task(void);
+bool action_macro_is_playing(void);
+/* macros not played because queue was full */
+uint16_t action_macro_dropped(void);
 #else
 #define action_macro_play(macro)
+#define action_macro_play_ram(macro)
+#define action_macro_task()
+#define action_macro_is_playing()   false
+#define action_macro_dropped()      0
 #endif
 
 
@@ -42,16 +59,24 @@ void action_macro_play(const macro_t *macro_p);
  *   { KEY_UP,   code(0x04-0xff) }      // key up(2bytes)
  *   WAIT                               // wait milli-seconds
  *   INTERVAL                           // set interval between macro commands
+ *   { MODS_TYPE, mods, code }          // type key with modifiers(3bytes)
+ *   { MODS_SEQ, mods, code..., 0x00 }  // type keys(0x04-0xa4) with modifiers held
+ *   { STRING, ascii..., 0x00 }         // type ASCII string(1byte per char)
+ *   { REPEAT, count }                  // play commands till REPEAT_END count times
+ *   REPEAT_END                         // end of repeated commands
  *   END                                // stop macro execution
  *
+ * STRING handles Shift for ASCII with US layout by itself. A character
+ * costs one report, or two when same key is typed in a row. MODS_SEQ types
+ * keycodes the same way with the modifiers held through the sequence.
+ * REPEAT can't be nested. REPEAT(0) skips the commands till REPEAT_END.
+ *
  * Ideas(Not implemented):
- *   modifiers
  *   system usage
  *   consumer usage
  *   unicode usage
  *   function call
  *   conditionals
- *   loop
  */
 enum macro_command_id{
     /* 0x00 - 0x03 */
@@ -64,6 +89,11 @@ enum macro_command_id{
     /* 0x74 - 0x83 */
     WAIT                = 0x74,
     INTERVAL,
+    MODS_TYPE,
+    STRING,
+    REPEAT,
+    REPEAT_END,
+    MODS_SEQ,
 
     /* 0x84 - 0xf3 (reserved for keycode up) */
 
@@ -82,6 +112,21 @@ enum macro_command_id{
 #define TYPE(key)       DOWN(key), UP(key)
 #define WAIT(ms)        WAIT, (ms)
 #define INTERVAL(ms)    INTERVAL, (ms)
+#define MODS_TYPE(mods, key)    MODS_TYPE, (mods), (key)
+#define REPEAT(count)   REPEAT, (count)
+#define MODS_SEQ(mods, ...)     MODS_SEQ, (mods), __VA_ARGS__, END
+
+/* Macro which types ASCII string
+ *     MACRO_STR("Hello, world!\n")
+ */
+#define MACRO_STR(s) ({ \
+    static const struct { \
+        macro_t cmd; \
+        char    str[sizeof(s)]; \
+        macro_t end; \
+    } __attribute__ ((packed)) __m PROGMEM = { STRING, s, END }; \
+    (const macro_t *)&__m; \
+})
 
 /* key down */
 #define D(key)          DOWN(KC_##key)
@@ -93,6 +138,8 @@ enum macro_command_id{
 #define W(ms)           WAIT(ms)
 /* interval */
 #define I(ms)           INTERVAL(ms)
+/* type key with a modifier */
+#define TM(mod, key)    MODS_TYPE(MOD_BIT(KC_##mod), KC_##key)
 
 /* for backward comaptibility */
 #define MD(key)         DOWN(KC_##key)
@@ -2,7 +2,10 @@
 #include <stdbool.h>
 #include "action.h"
 #include "action_tapping.h"
+#include "action_oneshot.h"
+#include "host.h"
 #include "timer.h"
+#include "trace.h"
 
 #ifdef DEBUG_ACTION
 #include "debug.h"
@@ -46,11 +49,18 @@ void action_tapping_process(keyrecord_t record)
         if (!waiting_buffer_enq(record)) {
             // clear all in case of overflow.
             debug("OVERFLOW: CLEAR ALL STATES\n");
+            trace0("tapping: waiting_buffer overflow");
             clear_keyboard();
+#ifndef NO_ACTION_ONESHOT
+            // pending oneshot mods would be applied to an unrelated key later
+            oneshot_cancel();
+#endif
             waiting_buffer_clear();
             tapping_key = (keyrecord_t){};
         }
     }
+    // events replayed from waiting_buffer below are sent in their own reports
+    host_flush_keyboard_report();
 
     // process waiting_buffer
     if (!IS_NOEVENT(record.event) && waiting_buffer_head != waiting_buffer_tail) {
@@ -60,6 +70,7 @@ void action_tapping_process(keyrecord_t record)
         if (process_tapping(&waiting_buffer[waiting_buffer_tail])) {
             debug("processed: waiting_buffer["); debug_dec(waiting_buffer_tail); debug("] = ");
             debug_record(waiting_buffer[waiting_buffer_tail]); debug("\n\n");
+            host_flush_keyboard_report();
         } else {
             break;
         }
@@ -87,6 +98,7 @@ bool process_tapping(keyrecord_t *keyp)
                 if (IS_TAPPING_KEY(event.key) && !event.pressed) {
                     // first tap!
                     debug("Tapping: First tap(0->1).\n");
+                    trace0("tapping: first tap");
                     tapping_key.tap.count = 1;
                     debug_tapping_key();
                     process_action(&tapping_key);
@@ -122,13 +134,14 @@ bool process_tapping(keyrecord_t *keyp)
             else {
                 if (IS_TAPPING_KEY(event.key) && !event.pressed) {
                     debug("Tapping: Tap release("); debug_dec(tapping_key.tap.count); debug(")\n");
+                    trace1("tapping: tap release(%u)", tapping_key.tap.count);
                     keyp->tap = tapping_key.tap;
                     process_action(keyp);
                     tapping_key = *keyp;
                     debug_tapping_key();
                     return true;
                 }
-                else if (is_tap_key(event.key) && event.pressed) {
+                else if (event.pressed && is_tap_key(event.key)) {
                     if (tapping_key.tap.count > 1) {
                         debug("Tapping: Start new tap with releasing last tap(>1).\n");
                         // unregister key
@@ -172,7 +185,7 @@ bool process_tapping(keyrecord_t *keyp)
                     tapping_key = (keyrecord_t){};
                     return true;
                 }
-                else if (is_tap_key(event.key) && event.pressed) {
+                else if (event.pressed && is_tap_key(event.key)) {
                     if (tapping_key.tap.count > 1) {
                         debug("Tapping: Start new tap with releasing last timeout tap(>1).\n");
                         // unregister key
@@ -208,6 +221,7 @@ bool process_tapping(keyrecord_t *keyp)
                         keyp->tap = tapping_key.tap;
                         if (keyp->tap.count < 15) keyp->tap.count += 1;
                         debug("Tapping: Tap press("); debug_dec(keyp->tap.count); debug(")\n");
+                        trace1("tapping: tap press(%u)", keyp->tap.count);
                         process_action(keyp);
                         tapping_key = *keyp;
                         debug_tapping_key();
@@ -29,7 +29,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define TAPPING_TOGGLE  5
 #endif
 
+/* size of buffer which holds key events while tapping is undecided */
+#ifndef WAITING_BUFFER_SIZE
 #define WAITING_BUFFER_SIZE 8
+#endif
+
+#if WAITING_BUFFER_SIZE < 2 || WAITING_BUFFER_SIZE > 255
+#   error "WAITING_BUFFER_SIZE must be between 2 and 255"
+#endif
 
 
 #ifndef NO_ACTION_TAPPING
@@ -32,6 +32,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "led.h"
 #include "command.h"
 #include "backlight.h"
+#include "trace.h"
+#include "host_mux.h"
 
 #ifdef MOUSEKEY_ENABLE
 #include "mousekey.h"
@@ -44,8 +46,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #   endif
 #endif
 
+#ifdef PROTOCOL_LUFA
+#   include "lufa.h"
+#endif
+
 #ifdef PROTOCOL_VUSB
 #   include "usbdrv.h"
+#   include "vusb.h"
 #endif
 
 
@@ -122,6 +129,9 @@ static void command_common_help(void)
     print("2/F2:	switch to Layer2 \n");
     print("3/F3:	switch to Layer3 \n");
     print("4/F4:	switch to Layer4 \n");
+#ifdef HOST_MUX_ENABLE
+    print("o:	switch to next host\n");
+#endif
     print("PScr:	power down/remote wake-up\n");
     print("Caps:	Lock Keyboard(Child Proof)\n");
     print("Paus:	jump to bootloader\n");
@@ -262,20 +272,59 @@ static bool command_common(uint8_t code)
         case KC_S:
             print("\n\n----- Status -----\n");
             print_val_hex8(host_keyboard_leds());
+            print_val_dec(host_keyboard_suppressed());
+            print_val_dec(action_macro_dropped());
 #ifdef PROTOCOL_PJRC
             print_val_hex8(UDCON);
             print_val_hex8(UDIEN);
             print_val_hex8(UDINT);
             print_val_hex8(usb_keyboard_leds);
-            print_val_hex8(usb_keyboard_protocol);
-            print_val_hex8(usb_keyboard_idle_config);
-            print_val_hex8(usb_keyboard_idle_count);
+            print_val_hex8(keyboard_protocol);
+            print_val_hex8(usb_keyboard_kbd.idle_config);
+            print_val_hex8(usb_keyboard_kbd.idle_count);
+            print_val_dec(usb_keyboard_kbd.superseded);
+#   ifdef NKRO_ENABLE
+            print_val_hex8(usb_keyboard_kbd2.idle_config);
+            print_val_hex8(usb_keyboard_kbd2.idle_count);
+            print_val_dec(usb_keyboard_kbd2.superseded);
+#   endif
 #endif
 
 #ifdef PROTOCOL_PJRC
 #   if USB_COUNT_SOF
             print_val_hex8(usbSofCount);
 #   endif
+#endif
+
+#ifdef PROTOCOL_VUSB
+            {
+                const vusb_sched_stat_t *s = vusb_sched_stat();
+                xprintf("usbPoll: missed:%u max:%ums held:%u\n",
+                        s->missed, s->max, s->held);
+            }
+            print_val_dec(vusb_kdelta_merged());
+            print_val_dec(vusb_kdelta_stalled());
+            print_val_dec(vusb_kdelta_overflow());
+            print_val_dec(vusb_ep3_overwritten());
+#endif
+
+#ifdef PROTOCOL_LUFA
+            {
+                const lufa_queue_stat_t *q;
+                for (uint8_t i = 0; (q = lufa_queue_stat(i)); i++) {
+                    xprintf("EP%u queue: depth:%u max:%u merged:%u dropped:%u\n",
+                            q->epnum, q->depth, q->max, q->merged, q->dropped);
+                }
+            }
+            print_val_dec(lufa_poll_rate());
+            print_val_dec(lufa_console_dropped());
+#endif
+#ifdef TRACE_ENABLE
+            print_val_dec(trace_dropped());
+#endif
+#ifdef HOST_MUX_ENABLE
+            print_val_hex8(host_mux_outputs());
+            print_val_dec(host_mux_focus());
 #endif
             break;
 #ifdef NKRO_ENABLE
@@ -306,6 +355,12 @@ static bool command_common(uint8_t code)
             _delay_ms(500);
 #endif
             break;
+#endif
+#ifdef HOST_MUX_ENABLE
+        case KC_O:
+            host_mux_next();
+            print("host: "); print_dec(host_mux_focus()); print("\n");
+            break;
 #endif
         case KC_ESC:
         case KC_GRV:
@@ -0,0 +1,159 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <avr/io.h>
+#include "action_macro.h"
+#include "keycode.h"
+#include "eeconfig.h"
+#include "debug.h"
+#include "dynamic_macro.h"
+
+
+/* macro_len and length of EEPROM block are uint8_t */
+#if DYNAMIC_MACRO_SIZE > 255
+#   error "DYNAMIC_MACRO_SIZE must be 255 or less"
+#endif
+
+#ifdef BOOTMAGIC_ENABLE
+/* saved macro takes EEPROM from EECONFIG_DYNAMIC_MACRO */
+_Static_assert((uintptr_t)EECONFIG_DYNAMIC_MACRO + DYNAMIC_MACRO_SIZE <= E2END + 1,
+               "DYNAMIC_MACRO_SIZE doesn't fit in EEPROM");
+#endif
+
+static macro_t macro_buf[DYNAMIC_MACRO_SIZE] = { END };
+static uint8_t macro_len = 0;
+static bool recording = false;
+
+/* keys pressed in recording and bytes kept for their release, so that
+ * played macro never leaves a key pressed */
+static uint8_t down_bits[32];
+static uint8_t release_len = 0;
+
+
+/* keycode 0x04-0x73 takes one byte, others need KEY_DOWN/KEY_UP prefix */
+static inline uint8_t code_len(uint8_t code)
+{
+    return (0x04 <= code && code <= 0x73) ? 1 : 2;
+}
+
+static void put(uint8_t code, bool pressed)
+{
+    if (code_len(code) == 1) {
+        macro_buf[macro_len++] = (pressed ? code : code | 0x80);
+    } else {
+        macro_buf[macro_len++] = (pressed ? KEY_DOWN : KEY_UP);
+        macro_buf[macro_len++] = code;
+    }
+    macro_buf[macro_len] = END;
+}
+
+static void release_all(void)
+{
+    for (uint8_t i = 0; i < sizeof(down_bits); i++) {
+        for (uint8_t j = 0; down_bits[i]; j++) {
+            if (!(down_bits[i] & (1<<j))) continue;
+            down_bits[i] &= ~(1<<j);
+            put(i<<3 | j, false);
+        }
+    }
+    release_len = 0;
+}
+
+
+void dynamic_macro_init(void)
+{
+#ifdef BOOTMAGIC_ENABLE
+    if (eeconfig_is_enabled()) {
+        eeconfig_read_dynamic_macro(macro_buf, DYNAMIC_MACRO_SIZE);
+    }
+#endif
+    // make sure it is terminated
+    macro_buf[DYNAMIC_MACRO_SIZE - 1] = END;
+}
+
+void dynamic_macro_record_start(void)
+{
+    if (action_macro_is_playing()) {
+        dprint("dynamic_macro: can't record while playing\n");
+        return;
+    }
+    dprint("dynamic_macro: record start\n");
+    macro_len = 0;
+    macro_buf[0] = END;
+    for (uint8_t i = 0; i < sizeof(down_bits); i++) down_bits[i] = 0;
+    release_len = 0;
+    recording = true;
+}
+
+void dynamic_macro_record_stop(void)
+{
+    if (!recording) return;
+    release_all();
+    dprintf("dynamic_macro: record stop(%u bytes)\n", macro_len);
+    recording = false;
+}
+
+bool dynamic_macro_is_recording(void)
+{
+    return recording;
+}
+
+void dynamic_macro_record(uint8_t code, bool pressed)
+{
+    if (!recording || code == KC_NO) return;
+
+    // A byte is always left for END, and bytes for releases of keys down.
+    uint8_t len = code_len(code);
+    bool down = down_bits[code>>3] & (1<<(code & 7));
+    if (pressed) {
+        if (macro_len + len + (down ? 0 : len) + release_len + 1 > DYNAMIC_MACRO_SIZE) goto FULL;
+        if (!down) {
+            down_bits[code>>3] |= (1<<(code & 7));
+            release_len += len;
+        }
+    } else {
+        if (down) {
+            down_bits[code>>3] &= ~(1<<(code & 7));
+            release_len -= len;
+        } else if (macro_len + len + release_len + 1 > DYNAMIC_MACRO_SIZE) {
+            goto FULL;
+        }
+    }
+    put(code, pressed);
+    return;
+
+FULL:
+    dprint("dynamic_macro: buffer full\n");
+    release_all();
+    recording = false;
+}
+
+void dynamic_macro_play(void)
+{
+    dynamic_macro_record_stop();
+    action_macro_play_ram(macro_buf);
+}
+
+/* Only bytes changed from EEPROM content are written to save its life. */
+void dynamic_macro_save(void)
+{
+#ifdef BOOTMAGIC_ENABLE
+    if (recording || action_macro_is_playing()) return;
+    if (!eeconfig_is_enabled()) return;
+    eeconfig_write_dynamic_macro(macro_buf, DYNAMIC_MACRO_SIZE);
+    dprint("dynamic_macro: saved\n");
+#endif
+}
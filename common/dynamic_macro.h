@@ -0,0 +1,49 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DYNAMIC_MACRO_H
+#define DYNAMIC_MACRO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* buffer size of recorded macro in bytes, including END */
+#ifndef DYNAMIC_MACRO_SIZE
+#define DYNAMIC_MACRO_SIZE  64
+#endif
+
+
+/* Dynamic macro
+ *
+ * Records keys registered while recording into RAM as macro commands,
+ * a key down or up takes one byte for most of keycodes. Keys still down when
+ * recording stops or buffer fills up are released at end of the macro, room
+ * for the releases is kept. Recorded macro is played with action_macro_play()
+ * and can be stored into EEPROM.
+ * Call these from action_function() to use.
+ */
+void dynamic_macro_init(void);
+void dynamic_macro_record_start(void);
+void dynamic_macro_record_stop(void);
+bool dynamic_macro_is_recording(void);
+void dynamic_macro_play(void);
+void dynamic_macro_save(void);
+
+/* called from register_code()/unregister_code() */
+void dynamic_macro_record(uint8_t code, bool pressed);
+
+#endif
@@ -13,6 +13,9 @@ void eeconfig_init(void)
 #ifdef BACKLIGHT_ENABLE
     eeprom_write_byte(EECONFIG_BACKLIGHT,      0);
 #endif
+#ifdef DYNAMIC_MACRO_ENABLE
+    eeprom_write_byte(EECONFIG_DYNAMIC_MACRO,  0);    // END
+#endif
 }
 
 void eeconfig_enable(void)
@@ -43,3 +46,9 @@ void eeconfig_write_keymap(uint8_t val) { eeprom_write_byte(EECONFIG_KEYMAP, val
 uint8_t eeconfig_read_backlight(void)      { return eeprom_read_byte(EECONFIG_BACKLIGHT); }
 void eeconfig_write_backlight(uint8_t val) { eeprom_write_byte(EECONFIG_BACKLIGHT, val); }
 #endif
+
+#ifdef DYNAMIC_MACRO_ENABLE
+void eeconfig_read_dynamic_macro(uint8_t *buf, uint8_t len) { eeprom_read_block(buf, EECONFIG_DYNAMIC_MACRO, len); }
+/* writes only bytes which differ to save EEPROM endurance */
+void eeconfig_write_dynamic_macro(const uint8_t *buf, uint8_t len) { eeprom_update_block(buf, EECONFIG_DYNAMIC_MACRO, len); }
+#endif
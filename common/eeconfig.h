@@ -31,6 +31,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define EECONFIG_KEYMAP                             (uint8_t *)4
 #define EECONFIG_MOUSEKEY_ACCEL                     (uint8_t *)5
 #define EECONFIG_BACKLIGHT                          (uint8_t *)6
+#define EECONFIG_DYNAMIC_MACRO                      (uint8_t *)7
 
 
 /* debug bit */
@@ -71,4 +72,9 @@ uint8_t eeconfig_read_backlight(void);
 void eeconfig_write_backlight(uint8_t val);
 #endif
 
+#ifdef DYNAMIC_MACRO_ENABLE
+void eeconfig_read_dynamic_macro(uint8_t *buf, uint8_t len);
+void eeconfig_write_dynamic_macro(const uint8_t *buf, uint8_t len);
+#endif
+
 #endif
@@ -16,15 +16,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdint.h>
-#include <avr/interrupt.h>
 #include "keycode.h"
 #include "host.h"
 #include "util.h"
 #include "debug.h"
 
 
+volatile uint8_t keyboard_protocol = 1;
+
 #ifdef NKRO_ENABLE
-bool keyboard_nkro = false;
+bool keyboard_nkro = true;
 #endif
 
 report_keyboard_t *keyboard_report = &(report_keyboard_t){};
@@ -32,20 +33,41 @@ report_mouse_t mouse_report = {};
 
 
 static host_driver_t *driver;
+static bool keyboard_report_dirty = false;
+static bool keyboard_report_added = false;
+static bool keyboard_report_deleted = false;
+/* last report delivered to driver */
+static report_keyboard_t last_keyboard_report = {};
+static bool last_keyboard_report_valid = false;
+#ifdef NKRO_ENABLE
+static bool last_keyboard_nkro = false;
+#endif
+static uint16_t keyboard_report_suppressed = 0;
 static uint16_t last_system_report = 0;
 static uint16_t last_consumer_report = 0;
 
-static inline void add_key_byte(uint8_t code);
-static inline void del_key_byte(uint8_t code);
-#ifdef NKRO_ENABLE
-static inline void add_key_bit(uint8_t code);
-static inline void del_key_bit(uint8_t code);
-#endif
+/* Keys pressed. keyboard_report is rendered from these when it is sent.
+ *   key_bits:  presence of each keycode
+ *   key_list:  keys in order of press, packed from the head
+ *   key_count: number of keys pressed, can exceed key_list in NKRO
+ */
+static uint8_t key_bits[32];
+static uint8_t key_list[REPORT_KEYS];
+static uint8_t key_list_len = 0;
+static uint8_t key_count = 0;
+
+static inline bool keyboard_report_changed(report_keyboard_t *report);
+static inline void keyboard_report_add(void);
+static inline void keyboard_report_del(void);
+static inline void keyboard_report_render(void);
 
 
 void host_set_driver(host_driver_t *d)
 {
+    // pending report belongs to old driver
+    host_flush_keyboard_report();
     driver = d;
+    last_keyboard_report_valid = false;
 }
 
 host_driver_t *host_get_driver(void)
@@ -62,6 +84,10 @@ uint8_t host_keyboard_leds(void)
 void host_keyboard_send(report_keyboard_t *report)
 {
     if (!driver) return;
+    if (!keyboard_report_changed(report)) {
+        keyboard_report_suppressed++;
+        return;
+    }
     (*driver->send_keyboard)(report);
 
     if (debug_keyboard) {
@@ -102,32 +128,59 @@ void host_consumer_send(uint16_t report)
 /* keyboard report utils */
 void host_add_key(uint8_t key)
 {
+    if (key_bits[key>>3] & 1<<(key&7)) return;
+
+    if (key_list_len == REPORT_KEYS
 #ifdef NKRO_ENABLE
-    if (keyboard_nkro) {
-        add_key_bit(key);
+            && !(keyboard_protocol && keyboard_nkro)
+#endif
+       ) {
+        dprintf("host_add_key: report full: %02X\n", key);
         return;
     }
+
+    keyboard_report_add();
+    if (key_list_len < REPORT_KEYS) {
+        key_list[key_list_len++] = key;
+    }
+#ifdef NKRO_ENABLE
+    if (keyboard_protocol && keyboard_nkro && (key>>3) >= REPORT_BITS) {
+        dprintf("host_add_key: can't report in NKRO: %02X\n", key);
+    }
 #endif
-    add_key_byte(key);
+    key_bits[key>>3] |= 1<<(key&7);
+    key_count++;
 }
 
 void host_del_key(uint8_t key)
 {
-#ifdef NKRO_ENABLE
-    if (keyboard_nkro) {
-        del_key_bit(key);
-        return;
+    if (!(key_bits[key>>3] & 1<<(key&7))) return;
+
+    keyboard_report_del();
+    key_bits[key>>3] &= ~(1<<(key&7));
+    key_count--;
+
+    for (uint8_t i = 0; i < key_list_len; i++) {
+        if (key_list[i] == key) {
+            key_list_len--;
+            for (; i < key_list_len; i++) {
+                key_list[i] = key_list[i + 1];
+            }
+            break;
+        }
     }
-#endif
-    del_key_byte(key);
 }
 
 void host_clear_keys(void)
 {
     // not clea  mods
-    for (int8_t i = 1; i < REPORT_SIZE; i++) {
-        keyboard_report->raw[i] = 0;
+    if (!key_count) return;
+    keyboard_report_del();
+    for (uint8_t i = 0; i < sizeof(key_bits); i++) {
+        key_bits[i] = 0;
     }
+    key_list_len = 0;
+    key_count = 0;
 }
 
 uint8_t host_get_mods(void)
@@ -137,32 +190,32 @@ uint8_t host_get_mods(void)
 
 void host_add_mods(uint8_t mods)
 {
+    keyboard_report_add();
     keyboard_report->mods |= mods;
 }
 
 void host_del_mods(uint8_t mods)
 {
+    keyboard_report_del();
     keyboard_report->mods &= ~mods;
 }
 
 void host_set_mods(uint8_t mods)
 {
+    if (keyboard_report->mods & ~mods) keyboard_report_del();
+    if (mods & ~keyboard_report->mods) keyboard_report_add();
     keyboard_report->mods = mods;
 }
 
 void host_clear_mods(void)
 {
+    keyboard_report_del();
     keyboard_report->mods = 0;
 }
 
 uint8_t host_has_anykey(void)
 {
-    uint8_t cnt = 0;
-    for (uint8_t i = 1; i < REPORT_SIZE; i++) {
-        if (keyboard_report->raw[i])
-            cnt++;
-    }
-    return cnt;
+    return key_count;
 }
 
 uint8_t host_has_anymod(void)
@@ -172,20 +225,31 @@ uint8_t host_has_anymod(void)
 
 uint8_t host_get_first_key(void)
 {
-#ifdef NKRO_ENABLE
-    if (keyboard_nkro) {
-        uint8_t i = 0;
-        for (; i < REPORT_BITS && !keyboard_report->nkro.bits[i]; i++)
-            ;
-        return i<<3 | biton(keyboard_report->nkro.bits[i]);
-    }
-#endif
-    return keyboard_report->keys[0];
+    if (key_list_len) return key_list[0];
+    if (!key_count) return 0;
+
+    // NKRO: keys in key_list are all released but others are still pressed
+    uint8_t i = 0;
+    for (; i < sizeof(key_bits) && !key_bits[i]; i++)
+        ;
+    return i<<3 | biton(key_bits[i]);
 }
 
+/* Report is not sent here but at host_flush_keyboard_report(), so that
+ * changes made while processing an event go to host in one report. */
 void host_send_keyboard_report(void)
 {
     if (!driver) return;
+    keyboard_report_dirty = true;
+}
+
+void host_flush_keyboard_report(void)
+{
+    keyboard_report_added = false;
+    keyboard_report_deleted = false;
+    if (!keyboard_report_dirty) return;
+    keyboard_report_dirty = false;
+    keyboard_report_render();
     host_keyboard_send(keyboard_report);
 }
 
@@ -204,50 +268,59 @@ uint16_t host_last_consumer_report(void)
     return last_consumer_report;
 }
 
-static inline void add_key_byte(uint8_t code)
+uint16_t host_keyboard_suppressed(void)
 {
-    int8_t i = 0;
-    int8_t empty = -1;
-    for (; i < REPORT_KEYS; i++) {
-        if (keyboard_report->keys[i] == code) {
-            break;
-        }
-        if (empty == -1 && keyboard_report->keys[i] == 0) {
-            empty = i;
-        }
+    return keyboard_report_suppressed;
+}
+
+/* Compare with last delivered report and update it. */
+static inline bool keyboard_report_changed(report_keyboard_t *report)
+{
+    bool changed = !last_keyboard_report_valid;
+#ifdef NKRO_ENABLE
+    // same bytes mean different thing or go to other endpoint
+    bool nkro = (keyboard_protocol && keyboard_nkro);
+    if (last_keyboard_nkro != nkro) {
+        last_keyboard_nkro = nkro;
+        changed = true;
     }
-    if (i == REPORT_KEYS) {
-        if (empty != -1) {
-            keyboard_report->keys[empty] = code;
+#endif
+    for (uint8_t i = 0; i < REPORT_SIZE; i++) {
+        if (last_keyboard_report.raw[i] != report->raw[i]) {
+            last_keyboard_report.raw[i] = report->raw[i];
+            changed = true;
         }
     }
+    last_keyboard_report_valid = true;
+    return changed;
 }
 
-static inline void del_key_byte(uint8_t code)
+/* Press and release of a key in pending report would cancel each other out
+ * and host would miss it. Send the pending report before direction changes. */
+static inline void keyboard_report_add(void)
 {
-    for (uint8_t i = 0; i < REPORT_KEYS; i++) {
-        if (keyboard_report->keys[i] == code) {
-            keyboard_report->keys[i] = 0;
-        }
-    }
+    if (keyboard_report_deleted) host_flush_keyboard_report();
+    keyboard_report_added = true;
 }
 
-#ifdef NKRO_ENABLE
-static inline void add_key_bit(uint8_t code)
+static inline void keyboard_report_del(void)
 {
-    if ((code>>3) < REPORT_BITS) {
-        keyboard_report->nkro.bits[code>>3] |= 1<<(code&7);
-    } else {
-        dprintf("add_key_bit: can't add: %02X\n", code);
-    }
+    if (keyboard_report_added) host_flush_keyboard_report();
+    keyboard_report_deleted = true;
 }
 
-static inline void del_key_bit(uint8_t code)
+static inline void keyboard_report_render(void)
 {
-    if ((code>>3) < REPORT_BITS) {
-        keyboard_report->nkro.bits[code>>3] &= ~(1<<(code&7));
-    } else {
-        dprintf("del_key_bit: can't del: %02X\n", code);
+#ifdef NKRO_ENABLE
+    if (keyboard_protocol && keyboard_nkro) {
+        for (uint8_t i = 0; i < REPORT_BITS; i++) {
+            keyboard_report->nkro.bits[i] = key_bits[i];
+        }
+        return;
     }
-}
 #endif
+    keyboard_report->reserved = 0;
+    for (uint8_t i = 0; i < REPORT_KEYS; i++) {
+        keyboard_report->keys[i] = (i < key_list_len ? key_list[i] : 0);
+    }
+}
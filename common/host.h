@@ -28,7 +28,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 extern "C" {
 #endif
 
+/* set by host with SET_PROTOCOL: 0=boot, 1=report, written in interrupt */
+extern volatile uint8_t keyboard_protocol;
+
 #ifdef NKRO_ENABLE
+/* NKRO is used only when host selects report protocol */
 extern bool keyboard_nkro;
 #endif
 
@@ -63,12 +67,14 @@ uint8_t host_has_anykey(void);
 uint8_t host_has_anymod(void);
 uint8_t host_get_first_key(void);
 void host_send_keyboard_report(void);
+void host_flush_keyboard_report(void);
 
 /* mouse report utils */
 uint8_t host_mouse_in_use(void);
 
 uint16_t host_last_sysytem_report(void);
 uint16_t host_last_consumer_report(void);
+uint16_t host_keyboard_suppressed(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,173 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "report.h"
+#include "host.h"
+#include "host_mux.h"
+#include "debug.h"
+
+
+static host_driver_t *drivers[HOST_MUX_DRIVERS];
+static uint8_t count = 0;
+static uint8_t outputs = 0;
+static uint8_t focus = 0;
+
+/* last reports sent, replayed to driver joining the outputs */
+static report_keyboard_t keyboard;
+static uint8_t mouse_buttons = 0;
+static uint16_t system_data = 0;
+static uint16_t consumer_data = 0;
+
+#define FOR_EACH_OUTPUT(d) \
+    for (uint8_t i = 0; i < count; i++) \
+        if ((outputs & (1<<i)) && ((d) = drivers[i]))
+
+
+static uint8_t keyboard_leds(void)
+{
+    if (focus >= count) return 0;
+    return (*drivers[focus]->keyboard_leds)();
+}
+
+static void send_keyboard(report_keyboard_t *report)
+{
+    host_driver_t *d;
+    keyboard = *report;
+    FOR_EACH_OUTPUT(d) (*d->send_keyboard)(report);
+}
+
+static void send_mouse(report_mouse_t *report)
+{
+    host_driver_t *d;
+    mouse_buttons = report->buttons;
+    FOR_EACH_OUTPUT(d) (*d->send_mouse)(report);
+}
+
+static void send_system(uint16_t data)
+{
+    host_driver_t *d;
+    system_data = data;
+    FOR_EACH_OUTPUT(d) (*d->send_system)(data);
+}
+
+static void send_consumer(uint16_t data)
+{
+    host_driver_t *d;
+    consumer_data = data;
+    FOR_EACH_OUTPUT(d) (*d->send_consumer)(data);
+}
+
+static host_driver_t driver = {
+    keyboard_leds,
+    send_keyboard,
+    send_mouse,
+    send_system,
+    send_consumer
+};
+
+__attribute__ ((weak))
+void host_mux_outputs_changed(uint8_t mask)
+{
+}
+
+host_driver_t *host_mux_driver(void)
+{
+    return &driver;
+}
+
+uint8_t host_mux_add(host_driver_t *d)
+{
+    if (count >= HOST_MUX_DRIVERS) return 0xFF;
+    drivers[count] = d;
+    return count++;
+}
+
+host_driver_t *host_mux_get(uint8_t index)
+{
+    return (index < count ? drivers[index] : 0);
+}
+
+static void release(host_driver_t *d)
+{
+    report_keyboard_t k = {};
+    report_mouse_t m = {};
+    (*d->send_keyboard)(&k);
+    if (mouse_buttons) (*d->send_mouse)(&m);
+    if (system_data) (*d->send_system)(0);
+    if (consumer_data) (*d->send_consumer)(0);
+}
+
+static void resync(host_driver_t *d)
+{
+    report_mouse_t m = { .buttons = mouse_buttons };
+    (*d->send_keyboard)(&keyboard);
+    if (mouse_buttons) (*d->send_mouse)(&m);
+    if (system_data) (*d->send_system)(system_data);
+    if (consumer_data) (*d->send_consumer)(consumer_data);
+}
+
+void host_mux_set_outputs(uint8_t mask)
+{
+    // report being built goes to old outputs
+    host_flush_keyboard_report();
+
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t bit = 1<<i;
+        if ((outputs & bit) && !(mask & bit)) release(drivers[i]);
+        if (!(outputs & bit) && (mask & bit)) resync(drivers[i]);
+    }
+    outputs = mask;
+
+    if (!(outputs & (1<<focus))) {
+        for (focus = 0; focus < count && !(outputs & (1<<focus)); focus++)
+            ;
+    }
+    dprintf("host_mux: outputs:%02X focus:%u\n", outputs, focus);
+    host_mux_outputs_changed(outputs);
+}
+
+uint8_t host_mux_outputs(void)
+{
+    return outputs;
+}
+
+void host_mux_switch(uint8_t index)
+{
+    if (index >= count) return;
+    focus = index;
+    host_mux_set_outputs(1<<index);
+}
+
+void host_mux_next(void)
+{
+    if (!count) return;
+    host_mux_switch((focus + 1) % count);
+}
+
+uint8_t host_mux_focus(void)
+{
+    return focus;
+}
+
+bool host_mux_enabled(host_driver_t *d)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        if (drivers[i] == d) return (outputs & (1<<i));
+    }
+    return false;
+}
@@ -0,0 +1,69 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef HOST_MUX_H
+#define HOST_MUX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "host_driver.h"
+
+
+/* Host driver multiplexer
+ *
+ * host_mux_driver() is set with host_set_driver() once and fans reports out
+ * to every driver enabled in the output mask. Each driver keeps its own
+ * queue. LED state is taken from the focused driver.
+ *
+ * Drivers are not re-initialized on switch. A driver leaving the mask gets
+ * reports with all keys and buttons released, a driver joining gets the
+ * current state so that keys held across the switch are consistent.
+ */
+#ifdef HOST_MUX_ENABLE
+
+#ifndef HOST_MUX_DRIVERS
+#define HOST_MUX_DRIVERS    2
+#endif
+#if HOST_MUX_DRIVERS > 8
+#error "HOST_MUX_DRIVERS must be 8 or less"
+#endif
+
+host_driver_t *host_mux_driver(void);
+/* registers driver and returns its index, 0xFF when no room */
+uint8_t host_mux_add(host_driver_t *driver);
+host_driver_t *host_mux_get(uint8_t index);
+
+/* sets bit mask of drivers which receive reports */
+void host_mux_set_outputs(uint8_t mask);
+uint8_t host_mux_outputs(void);
+/* sends reports to one driver only and takes LED state from it */
+void host_mux_switch(uint8_t index);
+/* switches to next registered driver */
+void host_mux_next(void);
+uint8_t host_mux_focus(void);
+bool host_mux_enabled(host_driver_t *driver);
+
+/* called after every change of outputs, whichever path made it(console,
+ * Magic command or boot). Protocol can override to gate its resources. */
+void host_mux_outputs_changed(uint8_t outputs);
+
+#else
+
+#define host_mux_enabled(driver)    (host_get_driver() == (driver))
+
+#endif
+
+#endif
@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "keyboard.h"
 #include "matrix.h"
 #include "keymap.h"
+#include "action_macro.h"
 #include "host.h"
 #include "led.h"
 #include "keycode.h"
@@ -32,6 +33,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "eeconfig.h"
 #include "mousekey.h"
 #include "backlight.h"
+#include "dynamic_macro.h"
+#include "trace.h"
 
 
 #ifdef MATRIX_HAS_GHOST
@@ -70,6 +73,10 @@ void keyboard_init(void)
 #ifdef BACKLIGHT_ENABLE
     backlight_init();
 #endif
+
+#ifdef DYNAMIC_MACRO_ENABLE
+    dynamic_macro_init();
+#endif
 }
 
 /*
@@ -114,6 +121,12 @@ void keyboard_task(void)
     action_exec(TICK);
 
 MATRIX_LOOP_END:
+    // play macro command
+    action_macro_task();
+
+    // send keyboard report once with all changes in this task
+    host_flush_keyboard_report();
+
 #ifdef MOUSEKEY_ENABLE
     // mousekey repeat & acceleration
     mousekey_task();
@@ -123,6 +136,9 @@ MATRIX_LOOP_END:
         led_status = host_keyboard_leds();
         keyboard_set_leds(led_status);
     }
+
+    // send a trace record
+    trace_task();
 }
 
 void keyboard_set_leds(uint8_t leds)
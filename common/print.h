@@ -27,7 +27,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include <avr/pgmspace.h>
+#include "progmem.h"
 #include "xprintf.h"
 #include "util.h"
 
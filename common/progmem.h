@@ -0,0 +1,30 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef PROGMEM_H
+#define PROGMEM_H 1
+
+#if defined(__AVR__)
+#   include <avr/pgmspace.h>
+#else
+/* Native(host) build: flash data is ordinary const data. */
+#   define PROGMEM
+#   define PSTR(x)              x
+#   define pgm_read_byte(p)     *((const unsigned char *)(p))
+#   define pgm_read_word(p)     *((const uint16_t *)(p))
+#endif
+
+#endif
@@ -26,6 +26,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define REPORT_ID_MOUSE     1
 #define REPORT_ID_SYSTEM    2
 #define REPORT_ID_CONSUMER  3
+#define REPORT_ID_NKRO      4
 
 /* mouse buttons */
 #define MOUSE_BTN1 (1<<0)
@@ -71,18 +72,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define SYSTEM_WAKE_UP          0x0083
 
 
+/* NKRO report: mods and bits of keycode 0-119, same in all protocols */
+#ifndef NKRO_REPORT_SIZE
+#define NKRO_REPORT_SIZE 16
+#endif
+#if !(NKRO_REPORT_SIZE == 16 || NKRO_REPORT_SIZE == 32)
+#error "NKRO_REPORT_SIZE must be 16 or 32"
+#endif
+
 /* key report size(NKRO or boot mode) */
-#if defined(PROTOCOL_PJRC) && defined(NKRO_ENABLE)
-#   include "usb.h"
-#   define REPORT_SIZE KBD2_SIZE
-#   define REPORT_KEYS (KBD2_SIZE - 2)
-#   define REPORT_BITS (KBD2_SIZE - 1)
-
-#elif defined(PROTOCOL_LUFA) && defined(NKRO_ENABLE)
-#   include "protocol/lufa/descriptor.h"
-#   define REPORT_SIZE NKRO_EPSIZE
-#   define REPORT_KEYS (NKRO_EPSIZE - 2)
-#   define REPORT_BITS (NKRO_EPSIZE - 1)
+#ifdef NKRO_ENABLE
+#   define REPORT_SIZE NKRO_REPORT_SIZE
+#   define REPORT_KEYS (NKRO_REPORT_SIZE - 2)
+#   define REPORT_BITS (NKRO_REPORT_SIZE - 1)
 
 #else
 #   define REPORT_SIZE 8
@@ -0,0 +1,282 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef REPORT_DESCRIPTOR_H
+#define REPORT_DESCRIPTOR_H
+
+#include "report.h"
+
+
+/* HID report descriptors shared by LUFA, PJRC and V-USB
+ *
+ * Each RD_* collection expands to initializer bytes, protocol stacks put them
+ * in their own PROGMEM arrays and choose report ID and LED output to fit their
+ * interfaces. Sizes come from report.h so that descriptor and report struct
+ * can't disagree; tool/hid_check.c parses these on host to make sure.
+ */
+
+/* short items */
+#define RD_U16(x)               ((x) & 0xFF), (((x) >> 8) & 0xFF)
+#define RD_USAGE_PAGE(x)        0x05, (x)
+#define RD_USAGE_PAGE16(x)      0x06, RD_U16(x)
+#define RD_USAGE(x)             0x09, (x)
+#define RD_USAGE16(x)           0x0A, RD_U16(x)
+#define RD_USAGE_MIN(x)         0x19, (x)
+#define RD_USAGE_MIN16(x)       0x1A, RD_U16(x)
+#define RD_USAGE_MAX(x)         0x29, (x)
+#define RD_USAGE_MAX16(x)       0x2A, RD_U16(x)
+#define RD_LOGICAL_MIN(x)       0x15, ((x) & 0xFF)
+#define RD_LOGICAL_MAX(x)       0x25, ((x) & 0xFF)
+#define RD_LOGICAL_MAX16(x)     0x26, RD_U16(x)
+#define RD_PHYSICAL_MIN(x)      0x35, (x)
+#define RD_PHYSICAL_MAX(x)      0x45, (x)
+#define RD_REPORT_SIZE(x)       0x75, (x)
+#define RD_REPORT_COUNT(x)      0x95, (x)
+#define RD_REPORT_ID(x)         0x85, (x)
+#define RD_INPUT(x)             0x81, (x)
+#define RD_OUTPUT(x)            0x91, (x)
+#define RD_COLLECTION(x)        0xA1, (x)
+#define RD_END_COLLECTION       0xC0
+
+/* main item flags */
+#define RD_DATA         0x00
+#define RD_CONST        0x01
+#define RD_ARRAY        0x00
+#define RD_VAR          0x02
+#define RD_ABS          0x00
+#define RD_REL          0x04
+#define RD_NON_VOLATILE 0x80
+
+
+/* keyboard parts */
+#define RD_KEYBOARD_MODS \
+    RD_USAGE_PAGE(0x07),            /* Key Codes */ \
+    RD_USAGE_MIN(0xE0),             /* Left Control */ \
+    RD_USAGE_MAX(0xE7),             /* Right GUI */ \
+    RD_LOGICAL_MIN(0), \
+    RD_LOGICAL_MAX(1), \
+    RD_REPORT_COUNT(8), \
+    RD_REPORT_SIZE(1), \
+    RD_INPUT(RD_DATA | RD_VAR | RD_ABS)
+
+#define RD_KEYBOARD_LEDS \
+    RD_USAGE_PAGE(0x08),            /* LEDs */ \
+    RD_USAGE_MIN(0x01),             /* Num Lock */ \
+    RD_USAGE_MAX(0x05),             /* Kana */ \
+    RD_REPORT_COUNT(5), \
+    RD_REPORT_SIZE(1), \
+    RD_OUTPUT(RD_DATA | RD_VAR | RD_ABS | RD_NON_VOLATILE), \
+    RD_REPORT_COUNT(1), \
+    RD_REPORT_SIZE(3), \
+    RD_OUTPUT(RD_CONST)
+
+/* Keyboard Protocol 1, HID 1.11 spec, Appendix B, page 59-60
+ * mods, reserved and `keys` keycodes */
+#define RD_KEYBOARD(keys) \
+    RD_USAGE_PAGE(0x01),            /* Generic Desktop */ \
+    RD_USAGE(0x06),                 /* Keyboard */ \
+    RD_COLLECTION(0x01),            /* Application */ \
+        RD_KEYBOARD_MODS, \
+        RD_REPORT_COUNT(1), \
+        RD_REPORT_SIZE(8), \
+        RD_INPUT(RD_CONST),         /* reserved */ \
+        RD_KEYBOARD_LEDS, \
+        RD_USAGE_PAGE(0x07),        /* Key Codes */ \
+        RD_USAGE_MIN(0x00), \
+        RD_USAGE_MAX(0xFF), \
+        RD_LOGICAL_MIN(0), \
+        RD_LOGICAL_MAX(0xFF), \
+        RD_REPORT_COUNT(keys), \
+        RD_REPORT_SIZE(8), \
+        RD_INPUT(RD_DATA | RD_ARRAY | RD_ABS), \
+    RD_END_COLLECTION
+
+/* mods and bitmap of keycode 0 to `bytes`*8-1 */
+#define RD_NKRO_BITS(bytes) \
+    RD_USAGE_PAGE(0x07),            /* Key Codes */ \
+    RD_USAGE_MIN(0x00), \
+    RD_USAGE_MAX((bytes)*8-1), \
+    RD_LOGICAL_MIN(0), \
+    RD_LOGICAL_MAX(1), \
+    RD_REPORT_COUNT((bytes)*8), \
+    RD_REPORT_SIZE(1), \
+    RD_INPUT(RD_DATA | RD_VAR | RD_ABS)
+
+/* NKRO on its own interface, receives LED state */
+#define RD_NKRO(bytes) \
+    RD_USAGE_PAGE(0x01),            /* Generic Desktop */ \
+    RD_USAGE(0x06),                 /* Keyboard */ \
+    RD_COLLECTION(0x01),            /* Application */ \
+        RD_KEYBOARD_MODS, \
+        RD_KEYBOARD_LEDS, \
+        RD_NKRO_BITS(bytes), \
+    RD_END_COLLECTION
+
+/* NKRO with report ID on shared interface, LED state comes to boot keyboard */
+#define RD_NKRO_ID(id, bytes) \
+    RD_USAGE_PAGE(0x01),            /* Generic Desktop */ \
+    RD_USAGE(0x06),                 /* Keyboard */ \
+    RD_COLLECTION(0x01),            /* Application */ \
+        RD_REPORT_ID(id), \
+        RD_KEYBOARD_MODS, \
+        RD_NKRO_BITS(bytes), \
+    RD_END_COLLECTION
+
+
+/* Mouse Protocol 1, HID 1.11 spec, Appendix B, page 59-60, with wheel extension
+ * http://www.microsoft.com/whdc/device/input/wheel.mspx
+ * fields of report_mouse_t: buttons, x, y, v, h */
+#define RD_MOUSE_POINTER \
+    RD_USAGE(0x01),                 /* Pointer */ \
+    RD_COLLECTION(0x00),            /* Physical */ \
+        RD_USAGE_PAGE(0x09),        /* Button */ \
+        RD_USAGE_MIN(0x01), \
+        RD_USAGE_MAX(0x05), \
+        RD_LOGICAL_MIN(0), \
+        RD_LOGICAL_MAX(1), \
+        RD_REPORT_COUNT(5), \
+        RD_REPORT_SIZE(1), \
+        RD_INPUT(RD_DATA | RD_VAR | RD_ABS), \
+        RD_REPORT_COUNT(1), \
+        RD_REPORT_SIZE(3), \
+        RD_INPUT(RD_CONST), \
+        RD_USAGE_PAGE(0x01),        /* Generic Desktop */ \
+        RD_USAGE(0x30),             /* X */ \
+        RD_USAGE(0x31),             /* Y */ \
+        RD_LOGICAL_MIN(-127), \
+        RD_LOGICAL_MAX(127), \
+        RD_REPORT_COUNT(2), \
+        RD_REPORT_SIZE(8), \
+        RD_INPUT(RD_DATA | RD_VAR | RD_REL), \
+        RD_USAGE(0x38),             /* Wheel */ \
+        RD_PHYSICAL_MIN(0), \
+        RD_PHYSICAL_MAX(0), \
+        RD_REPORT_COUNT(1), \
+        RD_INPUT(RD_DATA | RD_VAR | RD_REL), \
+        RD_USAGE_PAGE(0x0C),        /* Consumer */ \
+        RD_USAGE16(0x0238),         /* AC Pan */ \
+        RD_INPUT(RD_DATA | RD_VAR | RD_REL), \
+    RD_END_COLLECTION
+
+#define RD_MOUSE \
+    RD_USAGE_PAGE(0x01),            /* Generic Desktop */ \
+    RD_USAGE(0x02),                 /* Mouse */ \
+    RD_COLLECTION(0x01),            /* Application */ \
+        RD_MOUSE_POINTER, \
+    RD_END_COLLECTION
+
+#define RD_MOUSE_ID(id) \
+    RD_USAGE_PAGE(0x01),            /* Generic Desktop */ \
+    RD_USAGE(0x02),                 /* Mouse */ \
+    RD_COLLECTION(0x01),            /* Application */ \
+        RD_REPORT_ID(id), \
+        RD_MOUSE_POINTER, \
+    RD_END_COLLECTION
+
+
+/* audio controls & system controls
+ * http://www.microsoft.com/whdc/archive/w2kbd.mspx */
+#define RD_SYSTEM(id) \
+    RD_USAGE_PAGE(0x01),            /* Generic Desktop */ \
+    RD_USAGE(0x80),                 /* System Control */ \
+    RD_COLLECTION(0x01),            /* Application */ \
+        RD_REPORT_ID(id), \
+        RD_LOGICAL_MIN(0x01), \
+        RD_LOGICAL_MAX16(0x00B7), \
+        RD_USAGE_MIN(0x01),         /* System Power Down */ \
+        RD_USAGE_MAX(0xB7),         /* System Display LCD Autoscale */ \
+        RD_REPORT_COUNT(1), \
+        RD_REPORT_SIZE(16), \
+        RD_INPUT(RD_DATA | RD_ARRAY | RD_ABS), \
+    RD_END_COLLECTION
+
+#define RD_CONSUMER(id) \
+    RD_USAGE_PAGE(0x0C),            /* Consumer */ \
+    RD_USAGE(0x01),                 /* Consumer Control */ \
+    RD_COLLECTION(0x01),            /* Application */ \
+        RD_REPORT_ID(id), \
+        RD_LOGICAL_MIN(0x01), \
+        RD_LOGICAL_MAX16(0x029C), \
+        RD_USAGE_MIN(0x01), \
+        RD_USAGE_MAX16(0x029C),     /* AC Distribute Vertically */ \
+        RD_REPORT_COUNT(1), \
+        RD_REPORT_SIZE(16), \
+        RD_INPUT(RD_DATA | RD_ARRAY | RD_ABS), \
+    RD_END_COLLECTION
+
+
+/* report struct sizes the descriptors above describe */
+#define RD_KEYBOARD_SIZE    8
+#define RD_MOUSE_SIZE       5
+#define RD_EXTRA_SIZE       2
+#ifdef NKRO_ENABLE
+#   define RD_NKRO_SIZE     NKRO_REPORT_SIZE
+#endif
+
+
+/* Descriptors as each protocol stack composes them
+ *
+ * Stacks put these in their arrays as they are and use the endpoint sizes,
+ * so that tool/hid_check.c parses exactly what firmware sends to host.
+ */
+
+/* LUFA: boot keyboard, mouse, extra keys and NKRO on own interfaces */
+#define RD_LUFA_KEYBOARD_EPSIZE     8
+#define RD_LUFA_NKRO_EPSIZE         NKRO_REPORT_SIZE
+#define RD_LUFA_KEYBOARD    RD_KEYBOARD(RD_LUFA_KEYBOARD_EPSIZE - 2)
+#define RD_LUFA_MOUSE       RD_MOUSE
+#define RD_LUFA_EXTRAKEY    RD_SYSTEM(REPORT_ID_SYSTEM), RD_CONSUMER(REPORT_ID_CONSUMER)
+#define RD_LUFA_NKRO        RD_NKRO(RD_LUFA_NKRO_EPSIZE - 1)
+
+/* PJRC: same interfaces as LUFA */
+#define RD_PJRC_KBD_SIZE    8
+#define RD_PJRC_KBD2_SIZE   NKRO_REPORT_SIZE
+#define RD_PJRC_KEYBOARD    RD_KEYBOARD(RD_PJRC_KBD_SIZE - 2)
+#define RD_PJRC_MOUSE       RD_MOUSE
+#define RD_PJRC_EXTRAKEY    RD_SYSTEM(REPORT_ID_SYSTEM), RD_CONSUMER(REPORT_ID_CONSUMER)
+#define RD_PJRC_NKRO        RD_NKRO(RD_PJRC_KBD2_SIZE - 1)
+
+/* V-USB: boot keyboard on EP1, the others with report ID on EP3. Reports
+ * disabled in build are left out of EP3. Mouse stays when nothing else is
+ * enabled because the interface needs a descriptor. */
+#define RD_VUSB_KEYBOARD_SIZE   8
+#define RD_VUSB_KEYBOARD        RD_KEYBOARD(RD_VUSB_KEYBOARD_SIZE - 2)
+
+#if defined(MOUSE_ENABLE) || !(defined(EXTRAKEY_ENABLE) || defined(NKRO_ENABLE))
+#   define RD_VUSB_EP3_MOUSE    RD_MOUSE_ID(REPORT_ID_MOUSE),
+#else
+#   define RD_VUSB_EP3_MOUSE
+#endif
+#ifdef EXTRAKEY_ENABLE
+#   define RD_VUSB_EP3_EXTRAKEY RD_SYSTEM(REPORT_ID_SYSTEM), RD_CONSUMER(REPORT_ID_CONSUMER),
+#else
+#   define RD_VUSB_EP3_EXTRAKEY
+#endif
+#ifdef NKRO_ENABLE
+#   define RD_VUSB_EP3_NKRO     RD_NKRO_ID(REPORT_ID_NKRO, REPORT_BITS),
+#else
+#   define RD_VUSB_EP3_NKRO
+#endif
+#define RD_VUSB_EP3     RD_VUSB_EP3_MOUSE RD_VUSB_EP3_EXTRAKEY RD_VUSB_EP3_NKRO
+
+#define RD_ASSERT(name, cond)   typedef char rd_assert_##name[(cond) ? 1 : -1]
+RD_ASSERT(mouse_size, sizeof(report_mouse_t) == RD_MOUSE_SIZE);
+RD_ASSERT(keyboard_size, sizeof(report_keyboard_t) >= RD_KEYBOARD_SIZE);
+#ifdef NKRO_ENABLE
+RD_ASSERT(nkro_size, sizeof(report_keyboard_t) == RD_NKRO_SIZE);
+#endif
+
+#endif
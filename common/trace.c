@@ -0,0 +1,82 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "timer.h"
+#include "sendchar.h"
+#include "trace.h"
+
+
+static trace_record_t trace_buf[TRACE_BUFFER_SIZE];
+static uint8_t trace_tail = 0;
+static uint8_t trace_len = 0;
+static uint16_t dropped = 0;
+
+
+/* can be called from interrupt */
+void trace_put(uint16_t id, uint16_t arg0, uint16_t arg1)
+{
+    uint16_t time = timer_read();
+    uint8_t sreg = SREG;
+    cli();
+    if (trace_len < TRACE_BUFFER_SIZE) {
+        trace_record_t *r = &trace_buf[(trace_tail + trace_len) % TRACE_BUFFER_SIZE];
+        r->id = id;
+        r->time = time;
+        r->arg[0] = arg0;
+        r->arg[1] = arg1;
+        trace_len++;
+    } else {
+        dropped++;
+    }
+    SREG = sreg;
+}
+
+static void send_hex16(uint16_t v)
+{
+    for (int8_t s = 12; s >= 0; s -= 4) {
+        uint8_t n = (v >> s) & 0xF;
+        sendchar(n < 10 ? '0' + n : 'A' + n - 10);
+    }
+}
+
+/* sends one record per call not to hog console */
+void trace_task(void)
+{
+    if (!trace_len) return;
+
+    trace_record_t r;
+    uint8_t sreg = SREG;
+    cli();
+    r = trace_buf[trace_tail];
+    trace_tail = (trace_tail + 1) % TRACE_BUFFER_SIZE;
+    trace_len--;
+    SREG = sreg;
+
+    sendchar('#'); sendchar('T');
+    send_hex16(r.id);
+    send_hex16(r.time);
+    send_hex16(r.arg[0]);
+    send_hex16(r.arg[1]);
+    sendchar('\n');
+}
+
+uint16_t trace_dropped(void)
+{
+    return dropped;
+}
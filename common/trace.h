@@ -0,0 +1,75 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+
+/* Binary trace
+ *
+ * trace0/1/2() record format string ID, timestamp and up to two 16-bit
+ * arguments into RAM, nothing is formatted on the MCU. trace_task() sends
+ * a record per call over sendchar() as a line "#T" followed by 16 hex digits
+ * and tool/trace_decode.py turns it back into text using the ELF file.
+ *
+ * Format strings are placed in section .trace_fmt which rules.mk links with
+ * common/trace.ld as not allocated, it takes neither flash nor RAM. Offset
+ * of the string in the section is its ID.
+ */
+#ifdef TRACE_ENABLE
+
+/* number of records waiting to be sent */
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE   16
+#endif
+#if TRACE_BUFFER_SIZE > 255
+#error "TRACE_BUFFER_SIZE must be 255 or less"
+#endif
+
+typedef struct {
+    uint16_t id;
+    uint16_t time;
+    uint16_t arg[2];
+} trace_record_t;
+
+/* common/trace.ld places .trace_fmt at address 0 when linking */
+#define TRACE_ID(fmt) ({ \
+    static const char __trace_fmt[] \
+        __attribute__ ((section (".trace_fmt"), used)) = fmt; \
+    (uint16_t)(uintptr_t)__trace_fmt; \
+})
+
+#define trace0(fmt)         trace_put(TRACE_ID(fmt), 0, 0)
+#define trace1(fmt, a)      trace_put(TRACE_ID(fmt), (a), 0)
+#define trace2(fmt, a, b)   trace_put(TRACE_ID(fmt), (a), (b))
+
+void trace_put(uint16_t id, uint16_t arg0, uint16_t arg1);
+void trace_task(void);
+/* records dropped because buffer was full */
+uint16_t trace_dropped(void);
+
+#else
+
+#define trace0(fmt)
+#define trace1(fmt, a)
+#define trace2(fmt, a, b)
+#define trace_task()
+
+#endif
+
+#endif
@@ -0,0 +1,30 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef WAIT_H
+#define WAIT_H 1
+
+#if defined(__AVR__)
+#   include <util/delay.h>
+#   define wait_ms(ms)  _delay_ms(ms)
+#   define wait_us(us)  _delay_us(us)
+#else
+/* Native(host) build: time is given by event timestamps, don't spin. */
+#   define wait_ms(ms)
+#   define wait_us(us)
+#endif
+
+#endif
@@ -6,7 +6,7 @@
 #define XPRINTF_H
 
 #include <inttypes.h>
-#include <avr/pgmspace.h>
+#include "progmem.h"
 
 extern void (*xfunc_out)(uint8_t);
 #define xdev_out(func) xfunc_out = (void(*)(uint8_t))(func)
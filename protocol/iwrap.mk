@@ -4,6 +4,7 @@ OPT_DEFS += -DPROTOCOL_IWRAP
 
 SRC +=	$(IWRAP_DIR)/main.c \
 	$(IWRAP_DIR)/iwrap.c \
+	$(IWRAP_DIR)/iwrap_link.c \
 	$(IWRAP_DIR)/suart.S \
 	$(COMMON_DIR)/sendchar_uart.c \
 	$(COMMON_DIR)/uart.c
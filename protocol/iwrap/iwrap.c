@@ -33,8 +33,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "suart.h"
 #include "uart.h"
 #include "report.h"
+#include "host.h"
 #include "host_driver.h"
+#include "timer.h"
 #include "iwrap.h"
+#include "iwrap_link.h"
 #include "print.h"
 
 
@@ -48,7 +51,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MUX_FOOTER(LINK) xmit(LINK^0xff)
 
 
-static uint8_t connected = 0;
 //static uint8_t channel = 1;
 
 /* iWRAP buffer */
@@ -72,6 +74,7 @@ static void rcv_enq(char c)
     }
 }
 
+/* called only from main loop while ISR enqueues */
 static char rcv_deq(void)
 {
     char c = 0;
@@ -91,11 +94,6 @@ static char rcv_peek(void)
 }
 */
 
-static void rcv_clear(void)
-{
-    rcv_tail = rcv_head = 0;
-}
-
 /* iWRAP response */
 ISR(PCINT1_vect, ISR_BLOCK) // recv() runs away in case of ISR_NOBLOCK
 {
@@ -133,23 +131,204 @@ ISR(PCINT1_vect, ISR_BLOCK) // recv() runs away in case of ISR_NOBLOCK
 }
 
 
+/*------------------------------------------------------------------*
+ * TX buffer
+ *------------------------------------------------------------------*/
+/* HID reports are put into the buffer as whole MUX frames and sent from
+ * iwrap_task(). Keyboard and mouse reports wait in pending slots and are
+ * merged until IWRAP_TX_INTERVAL passes since the last frame, iWRAP can't
+ * send them faster than its radio interval anyway. */
+static uint8_t tx_buf[IWRAP_TX_BUF_SIZE];
+static uint8_t tx_head = 0;
+static uint8_t tx_len = 0;
+static uint16_t tx_timer = 0;
+
+static void tx_drain(void)
+{
+    while (tx_len) {
+        xmit(tx_buf[tx_head]);
+        tx_head = (tx_head + 1) % IWRAP_TX_BUF_SIZE;
+        tx_len--;
+    }
+}
+
+static void tx_put(uint8_t c)
+{
+    tx_buf[(tx_head + tx_len) % IWRAP_TX_BUF_SIZE] = c;
+    tx_len++;
+}
+
+/* HID raw mode report in MUX frame: 3.10 HID raw mode(iWRAP_HID_Application_Note.pdf) */
+static void tx_hid_frame(uint8_t report_id, const uint8_t *data, uint8_t len)
+{
+    // MUX header and footer(5), HID raw header(4)
+    if (tx_len + len + 9 > IWRAP_TX_BUF_SIZE)
+        tx_drain();
+    tx_put(0xbf);           // SOF
+    tx_put(0x01);           // Link
+    tx_put(0x00);           // Flags
+    tx_put(len + 4);        // Length
+    tx_put(0x9f);
+    tx_put(len + 2);        // Length
+    tx_put(0xa1);           // DATA(Input)
+    tx_put(report_id);
+    while (len--)
+        tx_put(*data++);
+    tx_put(0x01^0xff);
+    tx_timer = timer_read();
+}
+
+
+/* Keyboard report pending */
+static report_keyboard_t kbd_sent;
+static bool kbd_sent_nkro = false;
+static report_keyboard_t kbd_pending;
+static bool kbd_pending_nkro = false;
+static bool kbd_pending_valid = false;
+
+static bool has_key(report_keyboard_t *report, uint8_t code)
+{
+    for (uint8_t i = 0; i < 6; i++) {
+        if (report->keys[i] == code) return true;
+    }
+    return false;
+}
+
+/* pending report can be replaced with new one only if nothing changed from
+ * sent one changes back, otherwise host would miss press or release. */
+static bool kbd_mergeable(report_keyboard_t *report, bool nkro)
+{
+    report_keyboard_t *s = &kbd_sent, *p = &kbd_pending;
+    if (nkro != kbd_pending_nkro || nkro != kbd_sent_nkro) return false;
+    if ((p->mods ^ s->mods) & (report->mods ^ p->mods)) return false;
+#ifdef NKRO_ENABLE
+    if (nkro) {
+        for (uint8_t i = 0; i < REPORT_BITS; i++) {
+            if ((p->nkro.bits[i] ^ s->nkro.bits[i]) & (report->nkro.bits[i] ^ p->nkro.bits[i]))
+                return false;
+        }
+        return true;
+    }
+#endif
+    for (uint8_t i = 0; i < 6; i++) {
+        uint8_t k;
+        // pressed in pending and released in new
+        k = p->keys[i];
+        if (k && !has_key(s, k) && !has_key(report, k)) return false;
+        // released in pending and pressed again in new
+        k = s->keys[i];
+        if (k && !has_key(p, k) && has_key(report, k)) return false;
+    }
+    return true;
+}
+
+static void kbd_frame(void)
+{
+    if (!kbd_pending_valid) return;
+#ifdef NKRO_ENABLE
+    if (kbd_pending_nkro) {
+        // NKRO report needs descriptor with REPORT_ID_NKRO(iWRAP5.txt)
+        tx_hid_frame(REPORT_ID_NKRO, kbd_pending.raw, REPORT_SIZE);
+    } else
+#endif
+    {
+        // mods, reserved byte(always 0) and 6 keys
+        uint8_t r[8] = { kbd_pending.mods, 0 };
+        for (uint8_t i = 0; i < 6; i++) r[i + 2] = kbd_pending.keys[i];
+        tx_hid_frame(0x01, r, 8);
+    }
+    kbd_sent = kbd_pending;
+    kbd_sent_nkro = kbd_pending_nkro;
+    kbd_pending_valid = false;
+}
+
+
+/* Mouse report pending: button change is kept, motion is summed up */
+static uint8_t mouse_buttons = 0;
+static bool mouse_pending = false;
+static int16_t mouse_motion[4];     // x, y, v, h
+
+static int8_t mouse_motion_take(int16_t *m)
+{
+    int8_t d = (*m > 127 ? 127 : (*m < -127 ? -127 : *m));
+    *m -= d;
+    return d;
+}
+
+static void mouse_frame(void)
+{
+    while (mouse_pending) {
+        uint8_t r[5] = {
+            mouse_buttons,
+            mouse_motion_take(&mouse_motion[0]),
+            mouse_motion_take(&mouse_motion[1]),
+            mouse_motion_take(&mouse_motion[2]),
+            mouse_motion_take(&mouse_motion[3])
+        };
+        tx_hid_frame(0x02, r, 5);
+        mouse_pending = (mouse_motion[0] || mouse_motion[1] || mouse_motion[2] || mouse_motion[3]);
+    }
+}
+
+static void connection_task(void);
+static void power_task(void);
+static void activity(void);
+
+void iwrap_task(void)
+{
+    connection_task();
+    power_task();
+
+    if (timer_elapsed(tx_timer) >= IWRAP_TX_INTERVAL) {
+        kbd_frame();
+        mouse_frame();
+    }
+    tx_drain();
+}
+
+void iwrap_flush(void)
+{
+    kbd_frame();
+    mouse_frame();
+    tx_drain();
+}
+
+
 /*------------------------------------------------------------------*
  * iWRAP communication
  *------------------------------------------------------------------*/
+/* response lines to connection manager(iwrap_link.c) */
+static void connection_task(void)
+{
+    static char line[IWRAP_LINE_SIZE];
+    static uint8_t pos = 0;
+    char c;
+
+    while ((c = rcv_deq())) {
+        if (c == '\r') continue;
+        if (c == '\n') {
+            line[pos] = '\0';
+            if (pos) iwrap_link_parse(line);
+            pos = 0;
+        } else if (pos < IWRAP_LINE_SIZE - 1) {
+            line[pos++] = c;
+        }
+    }
+    iwrap_link_task();
+}
+
 void iwrap_init(void)
 {
     // reset iWRAP if in already MUX mode after AVR software-reset
     iwrap_send("RESET");
     iwrap_mux_send("RESET");
-    _delay_ms(3000);
-    iwrap_send("\r\nSET CONTROL MUX 1\r\n");
-    _delay_ms(500);
-    iwrap_check_connection();
+    iwrap_link_init();
 }
 
 void iwrap_mux_send(const char *s)
 {
-    rcv_clear();
+    // reports first
+    tx_drain();
     MUX_HEADER(0xff, strlen((char *)s));
     iwrap_send(s);
     MUX_FOOTER(0xff);
@@ -182,122 +361,98 @@ void iwrap_buf_send(void)
     iwrap_mux_send(buf);
 }
 
-void iwrap_call(void)
-{
-    char *p;
-
-    iwrap_mux_send("SET BT PAIR");
-    _delay_ms(500);
-
-    p = rcv_buf + rcv_tail;
-    while (!strncmp(p, "SET BT PAIR", 11)) {
-        p += 7;
-        strncpy(p, "CALL", 4);
-        strncpy(p+22, " 11 HID\n\0", 9);
-        print_S(p);
-        iwrap_mux_send(p);
-        // TODO: skip to next line
-        p += 57;
-
-        DEBUG_LED_CONFIG;
-        DEBUG_LED_ON;
-        _delay_ms(500);
-        DEBUG_LED_OFF;
-        _delay_ms(500);
-        DEBUG_LED_ON;
-        _delay_ms(500);
-        DEBUG_LED_OFF;
-        _delay_ms(500);
-        DEBUG_LED_ON;
-        _delay_ms(500);
-        DEBUG_LED_OFF;
-        _delay_ms(500);
-        DEBUG_LED_ON;
-        _delay_ms(500);
-        DEBUG_LED_OFF;
-        _delay_ms(500);
-        DEBUG_LED_ON;
-        _delay_ms(500);
-        DEBUG_LED_OFF;
-        _delay_ms(500);
-    }
-    iwrap_check_connection();
+/* sends command on the link: pre + link ID + post */
+static void link_command(const char *pre, const char *post)
+{
+    char s[IWRAP_LINE_SIZE];
+    uint8_t n = strlen(pre);
+    memcpy(s, pre, n);
+    s[n++] = iwrap_link_id();
+    strncpy(s + n, post, IWRAP_LINE_SIZE - n - 1);
+    s[IWRAP_LINE_SIZE - 1] = '\0';
+    iwrap_mux_send(s);
 }
 
-void iwrap_kill(void)
+void iwrap_active(void)
 {
-    char c;
-    iwrap_mux_send("LIST");
-    _delay_ms(500);
-
-    while ((c = rcv_deq()) && c != '\n') ;
-    if (strncmp(rcv_buf + rcv_tail, "LIST ", 5)) {
-        print("no connection to kill.\n");
-        return;
-    }
-    // skip 10 'space' chars
-    for (uint8_t i = 10; i; i--)
-        while ((c = rcv_deq()) && c != ' ') ;
-
-    char *p = rcv_buf + rcv_tail - 5;
-    strncpy(p, "KILL ", 5);
-    strncpy(p + 22, "\n\0", 2);
-    print_S(p);
-    iwrap_mux_send(p);
-    _delay_ms(500);
-
-    iwrap_check_connection();
+    link_command("ACTIVE ", "");
 }
 
-void iwrap_unpair(void)
+void iwrap_sniff(void)
 {
-    iwrap_mux_send("SET BT PAIR");
-    _delay_ms(500);
-
-    char *p = rcv_buf + rcv_tail;
-    if (!strncmp(p, "SET BT PAIR", 11)) {
-        strncpy(p+29, "\n\0", 2);
-        print_S(p);
-        iwrap_mux_send(p);
-    }
+    // SNIFF {link} {max} {min} {attempt} {timeout}
+    link_command("SNIFF ", " " IWRAP_SNIFF_PARAMS);
 }
 
-void iwrap_sleep(void)
+void iwrap_subrate(void)
 {
-    iwrap_mux_send("SLEEP");
+    // SET {link} SUBRATE {max_remote_latency} {min_remote_timeout} {min_local_timeout}
+    link_command("SET ", " SUBRATE " IWRAP_SUBRATE_PARAMS);
 }
 
-void iwrap_sniff(void)
+/* Power governor
+ *
+ * Link goes down a step at a time while no report is sent and comes
+ * back to active mode at once on the next report:
+ *
+ *   ACTIVE --IWRAP_SNIFF_IDLE--> SNIFF --IWRAP_SUBRATE_IDLE--> SUBRATE
+ *     ^                                                           |
+ *     +------------------------- report --------------------------+
+ *
+ * New connection starts in active mode. Deep sleep(iwrap_sleep) is left
+ * to main loop and also ends with the next report.
+ */
+static iwrap_power_t power = IWRAP_POWER_ACTIVE;
+static uint16_t activity_timer = 0;
+static iwrap_power_stat_t power_stat;
+
+static void set_power(iwrap_power_t p)
 {
+    power = p;
+    power_stat.transitions[p]++;
 }
 
-void iwrap_subrate(void)
+static void activity(void)
 {
+    activity_timer = timer_read();
+    if (power != IWRAP_POWER_ACTIVE) {
+        iwrap_active();
+        set_power(IWRAP_POWER_ACTIVE);
+    }
 }
 
-bool iwrap_failed(void)
+static void power_task(void)
 {
-    if (strncmp(rcv_buf, "SYNTAX ERROR", 12))
-        return true;
-    else
-        return false;
+    if (!iwrap_connected()) {
+        power = IWRAP_POWER_ACTIVE;
+        activity_timer = timer_read();
+        return;
+    }
+
+    uint16_t elapsed = timer_elapsed(activity_timer);
+    if (power == IWRAP_POWER_ACTIVE && elapsed > IWRAP_SNIFF_IDLE) {
+        iwrap_sniff();
+        set_power(IWRAP_POWER_SNIFF);
+    } else if (power == IWRAP_POWER_SNIFF && elapsed > IWRAP_SUBRATE_IDLE) {
+        iwrap_subrate();
+        set_power(IWRAP_POWER_SUBRATE);
+    }
 }
 
-uint8_t iwrap_connected(void)
+iwrap_power_t iwrap_power(void)
 {
-    return connected;
+    return power;
 }
 
-uint8_t iwrap_check_connection(void)
+const iwrap_power_stat_t *iwrap_power_stat(void)
 {
-    iwrap_mux_send("LIST");
-    _delay_ms(100);
+    return &power_stat;
+}
 
-    if (strncmp(rcv_buf, "LIST ", 5) || !strncmp(rcv_buf, "LIST 0", 6))
-        connected = 0;
-    else
-        connected = 1;
-    return connected;
+void iwrap_sleep(void)
+{
+    if (power != IWRAP_POWER_SLEEP) set_power(IWRAP_POWER_SLEEP);
+    iwrap_mux_send("SLEEP");
 }
 
 
@@ -329,40 +484,40 @@ static uint8_t keyboard_leds(void) {
 
 static void send_keyboard(report_keyboard_t *report)
 {
-    if (!iwrap_connected() && !iwrap_check_connection()) return;
-    MUX_HEADER(0x01, 0x0c);
-    // HID raw mode header
-    xmit(0x9f);
-    xmit(0x0a); // Length
-    xmit(0xa1); // DATA(Input)
-    xmit(0x01); // Report ID
-    xmit(report->mods);
-    xmit(0x00); // reserved byte(always 0)
-    xmit(report->keys[0]);
-    xmit(report->keys[1]);
-    xmit(report->keys[2]);
-    xmit(report->keys[3]);
-    xmit(report->keys[4]);
-    xmit(report->keys[5]);
-    MUX_FOOTER(0x01);
+    if (!iwrap_connected()) return;
+    activity();
+#ifdef NKRO_ENABLE
+    bool nkro = (keyboard_protocol && keyboard_nkro);
+#else
+    bool nkro = false;
+#endif
+    if (kbd_pending_valid && !kbd_mergeable(report, nkro))
+        kbd_frame();
+    kbd_pending = *report;
+    kbd_pending_nkro = nkro;
+    kbd_pending_valid = true;
+    iwrap_task();
 }
 
 static void send_mouse(report_mouse_t *report)
 {
 #if defined(MOUSEKEY_ENABLE) || defined(PS2_MOUSE_ENABLE)
-    if (!iwrap_connected() && !iwrap_check_connection()) return;
-    MUX_HEADER(0x01, 0x09);
-    // HID raw mode header
-    xmit(0x9f);
-    xmit(0x07); // Length
-    xmit(0xa1); // DATA(Input)
-    xmit(0x02); // Report ID
-    xmit(report->buttons);
-    xmit(report->x);
-    xmit(report->y);
-    xmit(report->v);
-    xmit(report->h);
-    MUX_FOOTER(0x01);
+    if (!iwrap_connected()) return;
+    activity();
+    // button change goes in its own report
+    if (mouse_pending && report->buttons != mouse_buttons)
+        mouse_frame();
+    if (report->buttons != mouse_buttons) mouse_pending = true;
+    mouse_buttons = report->buttons;
+    int8_t d[4] = { report->x, report->y, report->v, report->h };
+    for (uint8_t i = 0; i < 4; i++) {
+        int16_t m = mouse_motion[i] + d[i];
+        if (m > 1000) m = 1000;
+        if (m < -1000) m = -1000;
+        mouse_motion[i] = m;
+        if (d[i]) mouse_pending = true;
+    }
+    iwrap_task();
 #endif
 }
 
@@ -379,9 +534,10 @@ static void send_consumer(uint16_t data)
     uint8_t bits2 = 0;
     uint8_t bits3 = 0;
 
-    if (!iwrap_connected() && !iwrap_check_connection()) return;
+    if (!iwrap_connected()) return;
     if (data == last_data) return;
     last_data = data;
+    activity();
 
     // 3.10 HID raw mode(iWRAP_HID_Application_Note.pdf)
     switch (data) {
@@ -456,14 +612,8 @@ static void send_consumer(uint16_t data)
             break;
     }
 
-    MUX_HEADER(0x01, 0x07);
-    xmit(0x9f);
-    xmit(0x05); // Length
-    xmit(0xa1); // DATA(Input)
-    xmit(0x03); // Report ID
-    xmit(bits1);
-    xmit(bits2);
-    xmit(bits3);
-    MUX_FOOTER(0x01);
+    uint8_t r[3] = { bits1, bits2, bits3 };
+    tx_hid_frame(0x03, r, 3);
+    iwrap_task();
 #endif
 }
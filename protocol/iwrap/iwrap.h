@@ -26,10 +26,71 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* enable iWRAP MUX mode */
 #define MUX_MODE
 
+/* bytes of MUX frames waiting to be sent */
+#ifndef IWRAP_TX_BUF_SIZE
+#define IWRAP_TX_BUF_SIZE   64
+#endif
+/* keyboard and mouse reports within this ms are merged */
+#ifndef IWRAP_TX_INTERVAL
+#define IWRAP_TX_INTERVAL   10
+#endif
+
+/* connection manager */
+#ifndef IWRAP_LINE_SIZE
+#define IWRAP_LINE_SIZE     64      // longest response line kept
+#endif
+#ifndef IWRAP_RESPONSE_TIMEOUT
+#define IWRAP_RESPONSE_TIMEOUT  1000
+#endif
+#ifndef IWRAP_CALL_TIMEOUT
+#define IWRAP_CALL_TIMEOUT  10000
+#endif
+#ifndef IWRAP_BACKOFF_MIN
+#define IWRAP_BACKOFF_MIN   1000
+#endif
+#ifndef IWRAP_BACKOFF_MAX
+#define IWRAP_BACKOFF_MAX   60000
+#endif
+
+/* power governor: idle ms before each step down */
+#ifndef IWRAP_SNIFF_IDLE
+#define IWRAP_SNIFF_IDLE    500
+#endif
+#ifndef IWRAP_SUBRATE_IDLE
+#define IWRAP_SUBRATE_IDLE  2000
+#endif
+/* keyboard sleeps after this; timer stops while sleeping so others must be shorter */
+#ifndef IWRAP_SLEEP_IDLE
+#define IWRAP_SLEEP_IDLE    4000
+#endif
+/* max min attempt timeout in slots(0.625ms) */
+#ifndef IWRAP_SNIFF_PARAMS
+#define IWRAP_SNIFF_PARAMS  "40 20 1 8"
+#endif
+/* max_remote_latency min_remote_timeout min_local_timeout in slots */
+#ifndef IWRAP_SUBRATE_PARAMS
+#define IWRAP_SUBRATE_PARAMS "320 32 32"
+#endif
+
+typedef enum {
+    IWRAP_POWER_ACTIVE,
+    IWRAP_POWER_SNIFF,
+    IWRAP_POWER_SUBRATE,
+    IWRAP_POWER_SLEEP,
+} iwrap_power_t;
+
+typedef struct {
+    uint16_t transitions[4];    // entries to each iwrap_power_t
+} iwrap_power_stat_t;
+
 
 host_driver_t *iwrap_driver(void);
 
 void iwrap_init(void);
+/* runs connection manager and sends reports from main loop */
+void iwrap_task(void);
+/* sends all pending reports now */
+void iwrap_flush(void);
 void iwrap_send(const char *s);
 void iwrap_mux_send(const char *s);
 void iwrap_buf_send(void);
@@ -40,8 +101,11 @@ void iwrap_call(void);
 void iwrap_kill(void);
 void iwrap_unpair(void);
 void iwrap_sleep(void);
+void iwrap_active(void);
 void iwrap_sniff(void);
 void iwrap_subrate(void);
+iwrap_power_t iwrap_power(void);
+const iwrap_power_stat_t *iwrap_power_stat(void);
 bool iwrap_failed(void);
 uint8_t iwrap_connected(void);
 uint8_t iwrap_check_connection(void);
@@ -0,0 +1,284 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "timer.h"
+#include "iwrap.h"
+#include "iwrap_link.h"
+#include "print.h"
+
+
+/* Connection manager
+ *
+ * Commands are sent without waiting for response. iwrap_task() passes
+ * response and event lines from iWRAP to iwrap_link_parse() and state moves
+ * on them or on timeout in iwrap_link_task():
+ *
+ *   RESET --3s--> MUX --0.5s--> IDLE --backoff--> PAIR ----> CALLING
+ *                                ^                             |
+ *                                +---- NO CARRIER / timeout ---+
+ *   CONNECT, RING or LIST with link -> CONNECTED
+ *   NO CARRIER or LIST 0 on CONNECTED -> IDLE
+ *
+ * In IDLE paired host is called again after backoff time which doubles
+ * from IWRAP_BACKOFF_MIN up to IWRAP_BACKOFF_MAX on every failure.
+ */
+
+static iwrap_state_t state = IWRAP_RESET;
+static uint16_t state_timer = 0;
+static uint16_t backoff = 0;
+static bool auto_call = true;
+static bool syntax_error = false;
+static bool paused = false;
+
+static char peer[BDADDR_LEN + 1];
+/* link ID of connection */
+static char link_id = '0';
+
+static void set_state(iwrap_state_t s)
+{
+    state = s;
+    state_timer = timer_read();
+#ifdef DEBUG_LED
+    DEBUG_LED_CONFIG;
+    if (s == IWRAP_CALLING) DEBUG_LED_ON; else DEBUG_LED_OFF;
+#endif
+}
+
+static void call_failed(void)
+{
+    backoff = (backoff < IWRAP_BACKOFF_MIN) ? IWRAP_BACKOFF_MIN :
+              (backoff > IWRAP_BACKOFF_MAX / 2) ? IWRAP_BACKOFF_MAX : backoff * 2;
+    set_state(IWRAP_IDLE);
+}
+
+static void disconnected(void)
+{
+    // try again soon after link loss
+    backoff = IWRAP_BACKOFF_MIN;
+    set_state(IWRAP_IDLE);
+}
+
+static void call(void)
+{
+    char cmd[] = "CALL xx:xx:xx:xx:xx:xx 11 HID";
+    memcpy(cmd + 5, peer, BDADDR_LEN);
+    print("iWRAP: "); print_S(cmd); print("\n");
+    iwrap_mux_send(cmd);
+    set_state(IWRAP_CALLING);
+}
+
+/* copies n-th field(0 origin) separated by space if it looks like address */
+static bool get_bdaddr(const char *line, uint8_t n, char *addr)
+{
+    while (n--) {
+        line = strchr(line, ' ');
+        if (!line) return false;
+        line++;
+    }
+    if (strlen(line) < BDADDR_LEN || line[2] != ':' || line[14] != ':')
+        return false;
+    memcpy(addr, line, BDADDR_LEN);
+    addr[BDADDR_LEN] = '\0';
+    return true;
+}
+
+void iwrap_link_parse(const char *line)
+{
+    if (!strncmp(line, "RING ", 5)) {
+        // RING 0 78:dd:08:b7:e4:a2 11 HID
+        get_bdaddr(line, 2, peer);
+        link_id = line[5];
+        set_state(IWRAP_CONNECTED);
+    } else if (!strncmp(line, "CONNECT ", 8)) {
+        // CONNECT 0 HID 11
+        link_id = line[8];
+        set_state(IWRAP_CONNECTED);
+    } else if (!strncmp(line, "NO CARRIER", 10)) {
+        // NO CARRIER 0 ERROR 0
+        if (state == IWRAP_CALLING) call_failed();
+        else if (state == IWRAP_CONNECTED) disconnected();
+    } else if (!strncmp(line, "SET BT PAIR ", 12)) {
+        // SET BT PAIR 78:dd:08:b7:e4:a2 9e3d85c91bcae73fef8cc10bec18b42f
+        if (get_bdaddr(line, 3, peer) && state == IWRAP_PAIR) call();
+    } else if (!strncmp(line, "LIST ", 5)) {
+        if (strchr(line + 5, ' ')) {
+            // LIST 0 CONNECTED HID 672 0 0 5 8d 8d 78:dd:08:b7:e4:a2 ...
+            get_bdaddr(line, 10, peer);
+            link_id = line[5];
+        } else if (line[5] == '0') {
+            // LIST 0
+            if (state == IWRAP_CONNECTED) disconnected();
+        } else {
+            // LIST 1
+            set_state(IWRAP_CONNECTED);
+        }
+    } else if (!strncmp(line, "SYNTAX ERROR", 12)) {
+        syntax_error = true;
+    }
+}
+
+void iwrap_link_task(void)
+{
+    if (paused) return;
+
+    uint16_t elapsed = timer_elapsed(state_timer);
+    switch (state) {
+        case IWRAP_RESET:
+            if (elapsed > 3000) {
+                iwrap_send("\r\nSET CONTROL MUX 1\r\n");
+                set_state(IWRAP_MUX);
+            }
+            break;
+        case IWRAP_MUX:
+            if (elapsed > 500) {
+                set_state(IWRAP_IDLE);
+                iwrap_check_connection();
+            }
+            break;
+        case IWRAP_IDLE:
+            if (auto_call && elapsed >= backoff) {
+                if (peer[0]) {
+                    call();
+                } else {
+                    syntax_error = false;
+                    iwrap_mux_send("SET BT PAIR");
+                    set_state(IWRAP_PAIR);
+                }
+            }
+            break;
+        case IWRAP_PAIR:
+            // no paired host
+            if (elapsed > IWRAP_RESPONSE_TIMEOUT) call_failed();
+            break;
+        case IWRAP_CALLING:
+            if (elapsed > IWRAP_CALL_TIMEOUT) call_failed();
+            break;
+        case IWRAP_CONNECTED:
+            break;
+    }
+}
+
+void iwrap_link_init(void)
+{
+    set_state(IWRAP_RESET);
+}
+
+/* iWRAP out of host outputs: responses aren't received then, so calls would
+ * only time out and be repeated for nothing. */
+void iwrap_link_pause(bool pause)
+{
+    if (pause == paused) return;
+    paused = pause;
+    if (pause) return;
+
+    // responses may have been lost meanwhile
+    switch (state) {
+        case IWRAP_PAIR:
+        case IWRAP_CALLING:
+            backoff = 0;
+            set_state(IWRAP_IDLE);
+            break;
+        case IWRAP_CONNECTED:
+            iwrap_check_connection();
+            break;
+        default:
+            break;
+    }
+}
+
+iwrap_state_t iwrap_link_state(void)
+{
+    return state;
+}
+
+uint16_t iwrap_link_backoff(void)
+{
+    return backoff;
+}
+
+char iwrap_link_id(void)
+{
+    return link_id;
+}
+
+const char *iwrap_link_peer(void)
+{
+    return peer;
+}
+
+/* call paired host now and reconnect automatically from now on */
+void iwrap_call(void)
+{
+    auto_call = true;
+    backoff = 0;
+    if (state == IWRAP_IDLE || state == IWRAP_PAIR || state == IWRAP_CALLING) {
+        // forget address in case pairing was changed
+        peer[0] = '\0';
+        set_state(IWRAP_IDLE);
+    }
+}
+
+/* disconnect and stay disconnected until iwrap_call() */
+void iwrap_kill(void)
+{
+    auto_call = false;
+    if (state != IWRAP_CONNECTED || !peer[0]) {
+        print("no connection to kill.\n");
+        return;
+    }
+
+    char cmd[] = "KILL xx:xx:xx:xx:xx:xx";
+    memcpy(cmd + 5, peer, BDADDR_LEN);
+    print_S(cmd); print("\n");
+    iwrap_mux_send(cmd);
+    set_state(IWRAP_IDLE);
+}
+
+void iwrap_unpair(void)
+{
+    if (!peer[0]) {
+        print("no paired host known.\n");
+        return;
+    }
+
+    // SET BT PAIR without link key removes the pairing
+    char cmd[] = "SET BT PAIR xx:xx:xx:xx:xx:xx";
+    memcpy(cmd + 12, peer, BDADDR_LEN);
+    print_S(cmd); print("\n");
+    iwrap_mux_send(cmd);
+    peer[0] = '\0';
+}
+
+/* true when the last command was rejected by iWRAP */
+bool iwrap_failed(void)
+{
+    return syntax_error;
+}
+
+uint8_t iwrap_connected(void)
+{
+    return state == IWRAP_CONNECTED;
+}
+
+/* asks iWRAP with LIST, state is updated when the response comes */
+uint8_t iwrap_check_connection(void)
+{
+    if (!paused) iwrap_mux_send("LIST");
+    return iwrap_connected();
+}
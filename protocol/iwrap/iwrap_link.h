@@ -0,0 +1,57 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IWRAP_LINK_H
+#define IWRAP_LINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* Connection manager of iWRAP
+ *
+ * Only parses response lines and moves state on them and on time, so that it
+ * builds on host without software UART. Commands go out with iwrap_send()
+ * and iwrap_mux_send() of iwrap.c.
+ */
+typedef enum {
+    IWRAP_RESET,
+    IWRAP_MUX,
+    IWRAP_IDLE,
+    IWRAP_PAIR,         // waiting for SET BT PAIR
+    IWRAP_CALLING,      // waiting for CONNECT
+    IWRAP_CONNECTED,
+} iwrap_state_t;
+
+/* Bluetooth address of host: "xx:xx:xx:xx:xx:xx" */
+#define BDADDR_LEN 17
+
+void iwrap_link_init(void);
+/* a line from iWRAP without CR/LF */
+void iwrap_link_parse(const char *line);
+/* timeouts and calls, run from main loop */
+void iwrap_link_task(void);
+/* stops calls and timeouts while iWRAP is not in host outputs */
+void iwrap_link_pause(bool pause);
+
+iwrap_state_t iwrap_link_state(void);
+uint16_t iwrap_link_backoff(void);
+char iwrap_link_id(void);
+/* address of paired host, empty when unknown */
+const char *iwrap_link_peer(void);
+
+#endif
@@ -27,6 +27,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "host.h"
 #include "action.h"
 #include "iwrap.h"
+#include "iwrap_link.h"
+#include "host_mux.h"
 #ifdef PROTOCOL_VUSB
 #   include "vusb.h"
 #   include "usbdrv.h"
@@ -80,17 +82,28 @@ static void pullup_pins(void)
 
 
 #ifdef PROTOCOL_VUSB
+/* no USB host after this, e.g. on battery */
+#ifndef VUSB_ENUM_TIMEOUT
+#define VUSB_ENUM_TIMEOUT   3000
+#endif
+
+static bool vusb_attached = false;
+static uint16_t vusb_attached_time = 0;
+
 static void disable_vusb(void)
 {
     // disable interrupt & disconnect to prevent host from enumerating
     USB_INTR_ENABLE &= ~(1 << USB_INTR_ENABLE_BIT);
     usbDeviceDisconnect();
+    vusb_attached = false;
 }
 
 static void enable_vusb(void)
 {
     USB_INTR_ENABLE |= (1 << USB_INTR_ENABLE_BIT);
     usbDeviceConnect();
+    vusb_attached = true;
+    vusb_attached_time = timer_read();
 }
 
 static void init_vusb(void)
@@ -105,6 +118,19 @@ static void init_vusb(void)
     }
     enable_vusb();
 }
+
+static bool vusb_enumerating(void)
+{
+    return vusb_attached && !usbConfiguration &&
+           timer_elapsed(vusb_attached_time) < VUSB_ENUM_TIMEOUT;
+}
+
+/* USB host is there or may be yet. V-USB stays attached with HOST_MUX_ENABLE
+ * even on battery, so attached alone doesn't tell. */
+static bool vusb_host(void)
+{
+    return vusb_attached && (usbConfiguration || vusb_enumerating());
+}
 #endif
 
 void change_driver(host_driver_t *driver)
@@ -120,6 +146,38 @@ void change_driver(host_driver_t *driver)
     host_set_driver(driver);
 }
 
+#ifdef HOST_MUX_ENABLE
+static bool suart_rx = false;
+
+/* suart receive interrut(PC5/PCINT13) disturbs V-USB timing. It is enabled
+ * only while iWRAP is in outputs and V-USB is not being enumerated. */
+static void suart_rx_update(void)
+{
+#ifdef PROTOCOL_VUSB
+    bool on = host_mux_enabled(iwrap_driver()) && !vusb_enumerating();
+#else
+    bool on = host_mux_enabled(iwrap_driver());
+#endif
+    if (on == suart_rx) return;
+    suart_rx = on;
+    if (on) {
+        PCMSK1 |= 0b00100000;
+        PCICR  |= 0b00000010;
+    } else {
+        PCMSK1 &= ~(0b00100000);
+        PCICR  &= ~(0b00000010);
+    }
+}
+
+/* every switch of outputs comes here: console, Magic command and boot */
+void host_mux_outputs_changed(uint8_t outputs)
+{
+    suart_rx_update();
+    // suart xmit blocks interrupt per byte, nothing is sent unless selected
+    iwrap_link_pause(!host_mux_enabled(iwrap_driver()));
+}
+#endif
+
 
 static bool sleeping = false;
 static bool insomniac = false;   // TODO: should be false for power saving
@@ -151,11 +209,22 @@ int main(void)
     // PC5: Rx Input(pull-up)
     PORTC |= (1<<5);
     DDRC  &= ~(1<<5);
+#ifdef HOST_MUX_ENABLE
+    // suart receive interrut(PC5/PCINT13) is enabled by suart_rx_update()
+    // USB stays attached so that switching host doesn't wait enumeration
+    host_mux_add(iwrap_driver());
+#   ifdef PROTOCOL_VUSB
+    host_mux_add(vusb_driver());
+    init_vusb();
+#   endif
+    host_mux_switch(0);
+    host_set_driver(host_mux_driver());
+#else
     // suart receive interrut(PC5/PCINT13)
     PCMSK1 = 0b00100000;
     PCICR  = 0b00000010;
-
     host_set_driver(iwrap_driver());
+#endif
 
     print("iwrap_init()\n");
     iwrap_init();
@@ -164,26 +233,39 @@ int main(void)
     last_timer = timer_read();
     while (true) {
 #ifdef PROTOCOL_VUSB
-        if (host_get_driver() == vusb_driver())
-            usbPoll();
+        if (vusb_attached)
+            vusb_poll();
 #endif
         keyboard_task();
 #ifdef PROTOCOL_VUSB
-        if (host_get_driver() == vusb_driver())
+        if (vusb_attached)
             vusb_transfer_keyboard();
+#endif
+#ifdef HOST_MUX_ENABLE
+        suart_rx_update();
+        if (host_mux_enabled(iwrap_driver()))
+            iwrap_task();
+#else
+        if (host_get_driver() == iwrap_driver())
+            iwrap_task();
 #endif
         // TODO: depricated
         if (matrix_is_modified() || console()) {
             last_timer = timer_read();
             sleeping = false;
-        } else if (!sleeping && timer_elapsed(last_timer) > 4000) {
+        } else if (!sleeping && timer_elapsed(last_timer) > IWRAP_SLEEP_IDLE) {
             sleeping = true;
             iwrap_check_connection();
         }
 
         // TODO: suspend.h
-        if (host_get_driver() == iwrap_driver()) {
+        if (host_mux_enabled(iwrap_driver())
+#ifdef PROTOCOL_VUSB
+                && !vusb_host()
+#endif
+           ) {
             if (sleeping && !insomniac) {
+                iwrap_flush();
                 _delay_ms(1);   // wait for UART to send
                 iwrap_sleep();
                 sleep(WDTO_60MS);
@@ -262,8 +344,12 @@ static bool console_command(uint8_t c)
 #ifdef PROTOCOL_VUSB
             print("u: USB mode. switch to USB.\n");
             print("w: BT mode. switch to Bluetooth.\n");
+#   ifdef HOST_MUX_ENABLE
+            print("b: both. send to USB and Bluetooth.\n");
+#   endif
 #endif
             print("k: kill first connection.\n");
+            print("s: status. link power mode and transitions.\n");
             print("Del: unpair first pairing.\n");
             print("\n");
             return 0;
@@ -282,7 +368,21 @@ static bool console_command(uint8_t c)
             print("iwrap_call()\n");
             iwrap_call();
             return 1;
-#ifdef PROTOCOL_VUSB
+#if defined(PROTOCOL_VUSB) && defined(HOST_MUX_ENABLE)
+        case 'u':
+            print("USB mode\n");
+            host_mux_switch(1);
+            return 1;
+        case 'w':
+            print("iWRAP mode\n");
+            host_mux_switch(0);
+            return 1;
+        case 'b':
+            // iWRAP response can still break USB transfer
+            print("USB and iWRAP mode\n");
+            host_mux_set_outputs(0b11);
+            return 1;
+#elif defined(PROTOCOL_VUSB)
         case 'u':
             print("USB mode\n");
             init_vusb();
@@ -306,6 +406,17 @@ static bool console_command(uint8_t c)
             print("kill\n");
             iwrap_kill();
             return 1;
+        case 's':
+        {
+            const iwrap_power_stat_t *p = iwrap_power_stat();
+            print("connected: "); print_dec(iwrap_connected()); print("\n");
+            print("power: "); print_dec(iwrap_power()); print("\n");
+            print("active: "); print_dec(p->transitions[IWRAP_POWER_ACTIVE]); print("\n");
+            print("sniff: "); print_dec(p->transitions[IWRAP_POWER_SNIFF]); print("\n");
+            print("subrate: "); print_dec(p->transitions[IWRAP_POWER_SUBRATE]); print("\n");
+            print("sleep: "); print_dec(p->transitions[IWRAP_POWER_SLEEP]); print("\n");
+            return 1;
+        }
         case 0x7F:  // DELETE
             print("unpair\n");
             iwrap_unpair();
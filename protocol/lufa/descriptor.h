@@ -46,6 +46,7 @@
 
 #include <LUFA/Drivers/USB/USB.h>
 #include <avr/pgmspace.h>
+#include "report_descriptor.h"
 
 
 typedef struct
@@ -147,11 +148,41 @@ typedef struct
 #endif
 
 
-#define KEYBOARD_EPSIZE             8
+#define KEYBOARD_EPSIZE             RD_LUFA_KEYBOARD_EPSIZE
 #define MOUSE_EPSIZE                8
 #define EXTRAKEY_EPSIZE             8
 #define CONSOLE_EPSIZE              32
-#define NKRO_EPSIZE                 16
+#define NKRO_EPSIZE                 RD_LUFA_NKRO_EPSIZE
+
+
+/* bInterval in ms, can be defined in config.h */
+#ifndef KEYBOARD_POLLING_INTERVAL
+#   define KEYBOARD_POLLING_INTERVAL    1
+#endif
+#ifndef MOUSE_POLLING_INTERVAL
+#   define MOUSE_POLLING_INTERVAL       1
+#endif
+#ifndef EXTRAKEY_POLLING_INTERVAL
+#   define EXTRAKEY_POLLING_INTERVAL    1
+#endif
+#ifndef CONSOLE_POLLING_INTERVAL
+#   define CONSOLE_POLLING_INTERVAL     1
+#endif
+#ifndef NKRO_POLLING_INTERVAL
+#   define NKRO_POLLING_INTERVAL        1
+#endif
+
+/* Banks of report IN endpoints. With double bank next report can wait in
+ * the other bank while one is in flight. MCUs with 176 bytes of DPRAM
+ * can't afford it. */
+#ifndef REPORT_EPBANK
+#   if defined(__AVR_AT90USB162__) || defined(__AVR_AT90USB82__) || \
+       defined(__AVR_ATmega32U2__) || defined(__AVR_ATmega16U2__) || defined(__AVR_ATmega8U2__)
+#       define REPORT_EPBANK            ENDPOINT_BANK_SINGLE
+#   else
+#       define REPORT_EPBANK            ENDPOINT_BANK_DOUBLE
+#   endif
+#endif
 
 
 uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
@@ -53,7 +53,6 @@
 #include "lufa.h"
 
 static uint8_t idle_duration = 0;
-static uint8_t protocol_report = 1;
 static uint8_t keyboard_led_stats = 0;
 
 static report_keyboard_t keyboard_report_sent;
@@ -74,10 +73,230 @@ host_driver_t lufa_driver = {
 };
 
 
+/*******************************************************************************
+ * Report queue
+ ******************************************************************************/
+/* Reports wait in queue of each endpoint until its bank gets free, instead
+ * of spinning on the bank in send_*(). The queue is drained on SOF and from
+ * main loop.
+ *
+ * When it is full a new report is merged into the newest one if no change of
+ * that is undone by it, e.g. press and release of a key are never merged.
+ * Otherwise the newest report is overwritten and counted as dropped, keyboard
+ * task never waits for host. The latest state still reaches host. */
+
+/* merges report into newest one when it is safe, prev is report before it */
+typedef bool (*report_merge_t)(uint8_t *newest, const uint8_t *prev, const void *report);
+
+typedef struct {
+    uint8_t size;
+    uint8_t *buf;
+    uint8_t tail;
+    report_merge_t merge;
+    lufa_queue_stat_t stat;
+} report_queue_t;
+
+#define REPORT_QUEUE(name, ep, sz, mg) \
+    static uint8_t name##_buf[LUFA_QUEUE_SIZE * (sz)]; \
+    static report_queue_t name = { .size = (sz), .buf = name##_buf, .merge = (mg), .stat = { .epnum = (ep) } }
+
+static bool boot_has_key(const uint8_t *r, uint8_t code)
+{
+    for (uint8_t i = 2; i < KEYBOARD_EPSIZE; i++) {
+        if (r[i] == code) return true;
+    }
+    return false;
+}
+
+static bool keyboard_merge(uint8_t *newest, const uint8_t *prev, const void *report)
+{
+    const uint8_t *r = report;
+    if ((prev[0] ^ newest[0]) & (newest[0] ^ r[0])) return false;
+    for (uint8_t i = 2; i < KEYBOARD_EPSIZE; i++) {
+        // pressed in newest and released by report
+        uint8_t code = newest[i];
+        if (code && !boot_has_key(prev, code) && !boot_has_key(r, code)) return false;
+        // released in newest and pressed again by report
+        code = prev[i];
+        if (code && !boot_has_key(newest, code) && boot_has_key(r, code)) return false;
+    }
+    memcpy(newest, report, KEYBOARD_EPSIZE);
+    return true;
+}
+
+#ifdef NKRO_ENABLE
+static bool nkro_merge(uint8_t *newest, const uint8_t *prev, const void *report)
+{
+    const uint8_t *r = report;
+    for (uint8_t i = 0; i < NKRO_EPSIZE; i++) {
+        if ((prev[i] ^ newest[i]) & (newest[i] ^ r[i])) return false;
+    }
+    memcpy(newest, report, NKRO_EPSIZE);
+    return true;
+}
+#endif
+
+#ifdef EXTRAKEY_ENABLE
+/* system and consumer share the queue, only a repeat of the newest report
+ * is merged as any other change of usage would lose one */
+static bool extra_merge(uint8_t *newest, const uint8_t *prev, const void *report)
+{
+    return !memcmp(newest, report, sizeof(report_extra_t));
+}
+#endif
+
+#ifdef MOUSE_ENABLE
+/* motion is added up, only while buttons don't change */
+static bool mouse_merge(uint8_t *newest, const uint8_t *prev, const void *report)
+{
+    report_mouse_t *n = (report_mouse_t *)newest;
+    const report_mouse_t *r = report;
+    if (n->buttons != r->buttons) return false;
+    int16_t x = n->x + r->x, y = n->y + r->y, v = n->v + r->v, h = n->h + r->h;
+    if (x < -127 || x > 127 || y < -127 || y > 127 ||
+        v < -127 || v > 127 || h < -127 || h > 127) return false;
+    n->x = x; n->y = y; n->v = v; n->h = h;
+    return true;
+}
+#endif
+
+REPORT_QUEUE(keyboard_queue, KEYBOARD_IN_EPNUM, KEYBOARD_EPSIZE, keyboard_merge);
+#ifdef NKRO_ENABLE
+REPORT_QUEUE(nkro_queue, NKRO_IN_EPNUM, NKRO_EPSIZE, nkro_merge);
+#endif
+#ifdef MOUSE_ENABLE
+REPORT_QUEUE(mouse_queue, MOUSE_IN_EPNUM, sizeof(report_mouse_t), mouse_merge);
+#endif
+#ifdef EXTRAKEY_ENABLE
+REPORT_QUEUE(extra_queue, EXTRAKEY_IN_EPNUM, sizeof(report_extra_t), extra_merge);
+#endif
+
+static report_queue_t * const report_queues[] = {
+    &keyboard_queue,
+#ifdef NKRO_ENABLE
+    &nkro_queue,
+#endif
+#ifdef MOUSE_ENABLE
+    &mouse_queue,
+#endif
+#ifdef EXTRAKEY_ENABLE
+    &extra_queue,
+#endif
+};
+#define REPORT_QUEUE_COUNT  (sizeof(report_queues) / sizeof(report_queues[0]))
+
+/* call with interrupt disabled */
+static void report_queue_drain(report_queue_t *q)
+{
+    if (!q->stat.depth) return;
+    if (USB_DeviceState != DEVICE_STATE_Configured) return;
+
+    uint8_t ep = Endpoint_GetCurrentEndpoint();
+    Endpoint_SelectEndpoint(q->stat.epnum);
+    while (q->stat.depth && Endpoint_IsReadWriteAllowed()) {
+        Endpoint_Write_Stream_LE(&q->buf[q->tail * q->size], q->size, NULL);
+        Endpoint_ClearIN();
+        q->tail = (q->tail + 1) % LUFA_QUEUE_SIZE;
+        q->stat.depth--;
+    }
+    Endpoint_SelectEndpoint(ep);
+}
+
+#define REPORT_AT(q, i)     (&(q)->buf[((q)->tail + (i)) % LUFA_QUEUE_SIZE * (q)->size])
+
+static void report_queue_put(report_queue_t *q, const void *report)
+{
+    uint8_t sreg = SREG;
+    cli();
+    if (q->stat.depth < LUFA_QUEUE_SIZE) {
+        memcpy(REPORT_AT(q, q->stat.depth), report, q->size);
+        q->stat.depth++;
+        if (q->stat.max < q->stat.depth) q->stat.max = q->stat.depth;
+    } else if (q->merge(REPORT_AT(q, LUFA_QUEUE_SIZE - 1),
+                        REPORT_AT(q, LUFA_QUEUE_SIZE - 2), report)) {
+        q->stat.merged++;
+    } else {
+        memcpy(REPORT_AT(q, LUFA_QUEUE_SIZE - 1), report, q->size);
+        q->stat.dropped++;
+    }
+    // send right now if bank is free
+    report_queue_drain(q);
+    SREG = sreg;
+}
+
+static void report_queue_task(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    for (uint8_t i = 0; i < REPORT_QUEUE_COUNT; i++) {
+        report_queue_drain(report_queues[i]);
+    }
+    SREG = sreg;
+}
+
+const lufa_queue_stat_t *lufa_queue_stat(uint8_t index)
+{
+    if (index >= REPORT_QUEUE_COUNT) return 0;
+    return &report_queues[index]->stat;
+}
+
+
+/*******************************************************************************
+ * Host poll measurement
+ ******************************************************************************/
+/* Counts IN tokens host sends to keyboard endpoint. While the endpoint has
+ * nothing to send every poll is NAKed and leaves NAKINI, which is checked
+ * and cleared on each SOF. Polls in 1000 such idle frames equal rate in Hz. */
+static uint16_t poll_frames = 0;
+static uint16_t poll_count = 0;
+static uint16_t poll_rate = 0;
+static bool poll_idle = false;
+
+static void poll_measure(void)
+{
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+
+    uint8_t ep = Endpoint_GetCurrentEndpoint();
+    Endpoint_SelectEndpoint(KEYBOARD_IN_EPNUM);
+
+    // idle during whole last frame: no bank was busy at both of SOFs
+    bool idle = !(UESTA0X & (1<<NBUSYBK1 | 1<<NBUSYBK0));
+    if (idle && poll_idle) {
+        poll_frames++;
+        if (UEINTX & (1<<NAKINI)) poll_count++;
+        if (poll_frames == 1000) {
+            poll_rate = poll_count;
+            poll_frames = 0;
+            poll_count = 0;
+        }
+    }
+    poll_idle = idle;
+    // writing 1 to other flags has no effect
+    UEINTX = (uint8_t)~(1<<NAKINI);
+
+    Endpoint_SelectEndpoint(ep);
+}
+
+uint16_t lufa_poll_rate(void)
+{
+    return poll_rate;
+}
+
+
 /*******************************************************************************
  * Console
  ******************************************************************************/
 #ifdef CONSOLE_ENABLE
+/* sendchar() puts text into this buffer and Console_Task() sends it on SOF.
+ * When hid_listen isn't running host doesn't poll and text is dropped
+ * instead of stalling matrix scan. */
+static uint8_t console_buf[CONSOLE_BUFFER_SIZE];
+static uint8_t console_tail = 0;
+static uint8_t console_len = 0;
+static uint16_t console_dropped = 0;
+
+/* called on SOF */
 static void Console_Task(void)
 {
     /* Device must be connected and configured for the task to run */
@@ -118,12 +337,17 @@ static void Console_Task(void)
         return;
     }
 
-    // fill empty bank
-    while (Endpoint_IsReadWriteAllowed())
-        Endpoint_Write_8(0);
-
-    // flash senchar packet
-    if (Endpoint_IsINReady()) {
+    // send buffered text in packets padded with zero
+    while (console_len && Endpoint_IsReadWriteAllowed()) {
+        uint8_t n = CONSOLE_EPSIZE;
+        while (n && console_len) {
+            Endpoint_Write_8(console_buf[console_tail]);
+            console_tail = (console_tail + 1) % CONSOLE_BUFFER_SIZE;
+            console_len--;
+            n--;
+        }
+        while (n--)
+            Endpoint_Write_8(0);
         Endpoint_ClearIN();
     }
 
@@ -157,6 +381,8 @@ void EVENT_USB_Device_Disconnect(void)
 
 void EVENT_USB_Device_Reset(void)
 {
+    // HID device comes back in report protocol after reset
+    keyboard_protocol = 1;
 }
 
 void EVENT_USB_Device_Suspend()
@@ -179,6 +405,9 @@ void EVENT_USB_Device_WakeUp()
 void EVENT_USB_Device_StartOfFrame(void)
 {
     Console_Task();
+    // before queue refills the endpoint
+    poll_measure();
+    report_queue_task();
 }
 
 /** Event handler for the USB_ConfigurationChanged event.
@@ -197,20 +426,25 @@ void EVENT_USB_Device_ConfigurationChanged(void)
 {
     bool ConfigSuccess = true;
 
+    /* discard reports for previous configuration */
+    for (uint8_t i = 0; i < REPORT_QUEUE_COUNT; i++) {
+        report_queues[i]->stat.depth = 0;
+    }
+
     /* Setup Keyboard HID Report Endpoints */
     ConfigSuccess &= ENDPOINT_CONFIG(KEYBOARD_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
-                                     KEYBOARD_EPSIZE, ENDPOINT_BANK_SINGLE);
+                                     KEYBOARD_EPSIZE, REPORT_EPBANK);
 
 #ifdef MOUSE_ENABLE
     /* Setup Mouse HID Report Endpoint */
     ConfigSuccess &= ENDPOINT_CONFIG(MOUSE_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
-                                     MOUSE_EPSIZE, ENDPOINT_BANK_SINGLE);
+                                     MOUSE_EPSIZE, REPORT_EPBANK);
 #endif
 
 #ifdef EXTRAKEY_ENABLE
     /* Setup Extra HID Report Endpoint */
     ConfigSuccess &= ENDPOINT_CONFIG(EXTRAKEY_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
-                                     EXTRAKEY_EPSIZE, ENDPOINT_BANK_SINGLE);
+                                     EXTRAKEY_EPSIZE, REPORT_EPBANK);
 #endif
 
 #ifdef CONSOLE_ENABLE
@@ -224,7 +458,7 @@ void EVENT_USB_Device_ConfigurationChanged(void)
 #ifdef NKRO_ENABLE
     /* Setup NKRO HID Report Endpoints */
     ConfigSuccess &= ENDPOINT_CONFIG(NKRO_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
-                                     NKRO_EPSIZE, ENDPOINT_BANK_SINGLE);
+                                     NKRO_EPSIZE, REPORT_EPBANK);
 #endif
 }
 
@@ -241,6 +475,27 @@ Boot Keyboard   Required    Optional    Required    Required    Required    Requ
 Non-Boot Keybrd Required    Optional    Required    Required    Optional    Optional
 Other Device    Required    Optional    Optional    Optional    Optional    Optional
 */
+/* Wait for control endpoint. With INTERRUPT_CONTROL_ENDPOINT this runs in ISR,
+ * give up when host goes away or aborts the request with new SETUP. State
+ * of device isn't updated while in ISR, so time is bounded by frame number
+ * and suspend is seen from its interrupt flag, as frames stop then. */
+#ifndef CONTROL_WAIT_FRAMES
+#define CONTROL_WAIT_FRAMES     50
+#endif
+#define CONTROL_WAIT(cond) ({ \
+    bool ready = true; \
+    uint16_t frame = USB_Device_GetFrameNumber(); \
+    while (!(cond)) { \
+        if (USB_DeviceState == DEVICE_STATE_Unattached || Endpoint_IsSETUPReceived() || \
+            (UDINT & (1<<SUSPI)) || \
+            ((USB_Device_GetFrameNumber() - frame) & 0x7FF) > CONTROL_WAIT_FRAMES) { \
+            ready = false; \
+            break; \
+        } \
+    } \
+    ready; \
+})
+
 /** Event handler for the USB_ControlRequest event.
  *  This is fired before passing along unhandled control requests to the library for processing internally.
  */
@@ -281,10 +536,8 @@ void EVENT_USB_Device_ControlRequest(void)
                 case KEYBOARD_INTERFACE:
                     Endpoint_ClearSETUP();
 
-                    while (!(Endpoint_IsOUTReceived())) {
-                        if (USB_DeviceState == DEVICE_STATE_Unattached)
-                          return;
-                    }
+                    if (!CONTROL_WAIT(Endpoint_IsOUTReceived()))
+                        return;
                     keyboard_led_stats = Endpoint_Read_8();
 
                     Endpoint_ClearOUT();
@@ -300,8 +553,9 @@ void EVENT_USB_Device_ControlRequest(void)
             if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE))
             {
                 Endpoint_ClearSETUP();
-                while (!(Endpoint_IsINReady()));
-                Endpoint_Write_8(protocol_report);
+                if (!CONTROL_WAIT(Endpoint_IsINReady()))
+                    return;
+                Endpoint_Write_8(keyboard_protocol);
                 Endpoint_ClearIN();
                 Endpoint_ClearStatusStage();
             }
@@ -313,7 +567,7 @@ void EVENT_USB_Device_ControlRequest(void)
                 Endpoint_ClearSETUP();
                 Endpoint_ClearStatusStage();
 
-                protocol_report = ((USB_ControlRequest.wValue & 0xFF) != 0x00);
+                keyboard_protocol = ((USB_ControlRequest.wValue & 0xFF) != 0x00);
             }
 
             break;
@@ -331,7 +585,8 @@ void EVENT_USB_Device_ControlRequest(void)
             if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE))
             {
                 Endpoint_ClearSETUP();
-                while (!(Endpoint_IsINReady()));
+                if (!CONTROL_WAIT(Endpoint_IsINReady()))
+                    return;
                 Endpoint_Write_8(idle_duration);
                 Endpoint_ClearIN();
                 Endpoint_ClearStatusStage();
@@ -351,69 +606,36 @@ static uint8_t keyboard_leds(void)
 
 static void send_keyboard(report_keyboard_t *report)
 {
-    uint8_t timeout = 0;
-
     if (USB_DeviceState != DEVICE_STATE_Configured)
         return;
 
-    /* Select the Keyboard Report Endpoint */
-#ifdef NKRO_ENABLE
-    if (keyboard_nkro) {
-        Endpoint_SelectEndpoint(NKRO_IN_EPNUM);
-    }
-    else
-#endif
-    {
-        Endpoint_SelectEndpoint(KEYBOARD_IN_EPNUM);
-    }
-
-    /* Check if Keyboard Endpoint Ready for Read/Write */
-    while (--timeout && !Endpoint_IsReadWriteAllowed()) ;
-
-    /* Write Keyboard Report Data */
 #ifdef NKRO_ENABLE
-    if (keyboard_nkro) {
-        Endpoint_Write_Stream_LE(report, NKRO_EPSIZE, NULL);
+    if (keyboard_protocol && keyboard_nkro) {
+        report_queue_put(&nkro_queue, report);
     }
     else
 #endif
     {
         /* boot mode */
-        Endpoint_Write_Stream_LE(report, KEYBOARD_EPSIZE, NULL);
+        report_queue_put(&keyboard_queue, report);
     }
 
-    /* Finalize the stream transfer to send the last packet */
-    Endpoint_ClearIN();
-
     keyboard_report_sent = *report;
 }
 
 static void send_mouse(report_mouse_t *report)
 {
 #ifdef MOUSE_ENABLE
-    uint8_t timeout = 0;
-
     if (USB_DeviceState != DEVICE_STATE_Configured)
         return;
 
-    /* Select the Mouse Report Endpoint */
-    Endpoint_SelectEndpoint(MOUSE_IN_EPNUM);
-
-    /* Check if Mouse Endpoint Ready for Read/Write */
-    while (--timeout && !Endpoint_IsReadWriteAllowed()) ;
-
-    /* Write Mouse Report Data */
-    Endpoint_Write_Stream_LE(report, sizeof(report_mouse_t), NULL);
-
-    /* Finalize the stream transfer to send the last packet */
-    Endpoint_ClearIN();
+    report_queue_put(&mouse_queue, report);
 #endif
 }
 
 static void send_system(uint16_t data)
 {
-    uint8_t timeout = 0;
-
+#ifdef EXTRAKEY_ENABLE
     if (USB_DeviceState != DEVICE_STATE_Configured)
         return;
 
@@ -421,16 +643,13 @@ static void send_system(uint16_t data)
         .report_id = REPORT_ID_SYSTEM,
         .usage = data
     };
-    Endpoint_SelectEndpoint(EXTRAKEY_IN_EPNUM);
-    while (--timeout && !Endpoint_IsReadWriteAllowed()) ;
-    Endpoint_Write_Stream_LE(&r, sizeof(report_extra_t), NULL);
-    Endpoint_ClearIN();
+    report_queue_put(&extra_queue, &r);
+#endif
 }
 
 static void send_consumer(uint16_t data)
 {
-    uint8_t timeout = 0;
-
+#ifdef EXTRAKEY_ENABLE
     if (USB_DeviceState != DEVICE_STATE_Configured)
         return;
 
@@ -438,10 +657,8 @@ static void send_consumer(uint16_t data)
         .report_id = REPORT_ID_CONSUMER,
         .usage = data
     };
-    Endpoint_SelectEndpoint(EXTRAKEY_IN_EPNUM);
-    while (--timeout && !Endpoint_IsReadWriteAllowed()) ;
-    Endpoint_Write_Stream_LE(&r, sizeof(report_extra_t), NULL);
-    Endpoint_ClearIN();
+    report_queue_put(&extra_queue, &r);
+#endif
 }
 
 
@@ -449,66 +666,39 @@ static void send_consumer(uint16_t data)
  * sendchar
  ******************************************************************************/
 #ifdef CONSOLE_ENABLE
-#define SEND_TIMEOUT 5
 int8_t sendchar(uint8_t c)
 {
-    // Not wait once timeouted.
-    // Because sendchar() is called so many times, waiting each call causes big lag.
-    static bool timeouted = false;
-
     if (USB_DeviceState != DEVICE_STATE_Configured)
         return -1;
 
-    uint8_t ep = Endpoint_GetCurrentEndpoint();
-    Endpoint_SelectEndpoint(CONSOLE_IN_EPNUM);
-    if (!Endpoint_IsEnabled() || !Endpoint_IsConfigured()) {
-        Endpoint_SelectEndpoint(ep);
-        return -1;
-    }
-
-    if (timeouted && !Endpoint_IsReadWriteAllowed()) {
-        Endpoint_SelectEndpoint(ep);
-        return - 1;
+    int8_t ret = 0;
+    uint8_t sreg = SREG;
+    cli();
+    if (console_len < CONSOLE_BUFFER_SIZE) {
+        console_buf[(console_tail + console_len) % CONSOLE_BUFFER_SIZE] = c;
+        console_len++;
+    } else {
+        console_dropped++;
+        ret = -1;
     }
+    SREG = sreg;
+    return ret;
+}
 
-    timeouted = false;
-
-    uint8_t timeout = SEND_TIMEOUT;
-    uint16_t prevFN = USB_Device_GetFrameNumber();
-    while (!Endpoint_IsReadWriteAllowed()) {
-        switch (USB_DeviceState) {
-        case DEVICE_STATE_Unattached:
-        case DEVICE_STATE_Suspended:
-            return -1;
-        }
-        if (Endpoint_IsStalled()) {
-            Endpoint_SelectEndpoint(ep);
-            return -1;
-        }
-        if (prevFN != USB_Device_GetFrameNumber()) {
-            if (!(timeout--)) {
-                timeouted = true;
-                Endpoint_SelectEndpoint(ep);
-                return -1;
-            }
-            prevFN = USB_Device_GetFrameNumber();
-        }
-    }
-
-    Endpoint_Write_8(c);
-
-    // send when bank is full
-    if (!Endpoint_IsReadWriteAllowed())
-        Endpoint_ClearIN();
-
-    Endpoint_SelectEndpoint(ep);
-    return 0;
+uint16_t lufa_console_dropped(void)
+{
+    return console_dropped;
 }
 #else
 int8_t sendchar(uint8_t c)
 {
     return 0;
 }
+
+uint16_t lufa_console_dropped(void)
+{
+    return 0;
+}
 #endif
 
 
@@ -553,6 +743,7 @@ int main(void)
         }
 
         keyboard_task();
+        report_queue_task();
 
 #if !defined(INTERRUPT_CONTROL_ENDPOINT)
         USB_USBTask();
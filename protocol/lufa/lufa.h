@@ -56,6 +56,39 @@ extern "C" {
 
 extern host_driver_t lufa_driver;
 
+/* number of reports each endpoint can hold while host doesn't poll */
+#ifndef LUFA_QUEUE_SIZE
+#define LUFA_QUEUE_SIZE 4
+#endif
+#if LUFA_QUEUE_SIZE < 2
+#error "LUFA_QUEUE_SIZE must be at least 2"
+#endif
+
+typedef struct {
+    uint8_t  epnum;
+    uint8_t  depth;     // reports waiting now
+    uint8_t  max;       // most reports waited at once
+    uint16_t merged;    // reports merged into newest one when full
+    uint16_t dropped;   // reports overwritten by newer one when full
+} lufa_queue_stat_t;
+
+/* returns 0 when index is out of queues */
+const lufa_queue_stat_t *lufa_queue_stat(uint8_t index);
+
+/* host polls of keyboard endpoint per second, 0 until measured */
+uint16_t lufa_poll_rate(void);
+
+/* bytes of console text waiting for SOF */
+#ifndef CONSOLE_BUFFER_SIZE
+#define CONSOLE_BUFFER_SIZE 128
+#endif
+#if CONSOLE_BUFFER_SIZE > 255
+#error "CONSOLE_BUFFER_SIZE must be 255 or less"
+#endif
+
+/* characters dropped because console buffer was full */
+uint16_t lufa_console_dropped(void);
+
 #ifdef __cplusplus
 }
 #endif
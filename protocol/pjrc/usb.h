@@ -27,6 +27,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <avr/io.h>
+#include "report_descriptor.h"
 
 
 extern bool remote_wakeup;
@@ -121,7 +122,7 @@ void usb_remote_wakeup(void);
  *------------------------------------------------------------------*/
 #define KBD_INTERFACE		0
 #define KBD_ENDPOINT		1
-#define KBD_SIZE		8
+#define KBD_SIZE		RD_PJRC_KBD_SIZE
 #define KBD_BUFFER		EP_DOUBLE_BUFFER
 #define KBD_REPORT_KEYS		(KBD_SIZE - 2)
 
@@ -129,7 +130,7 @@ void usb_remote_wakeup(void);
 #ifdef NKRO_ENABLE
 #define KBD2_INTERFACE		4
 #define KBD2_ENDPOINT		5
-#define KBD2_SIZE		16
+#define KBD2_SIZE		RD_PJRC_KBD2_SIZE
 #define KBD2_BUFFER		EP_DOUBLE_BUFFER
 #define KBD2_REPORT_KEYS	(KBD2_SIZE - 1)
 #endif
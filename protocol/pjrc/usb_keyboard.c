@@ -31,24 +31,18 @@
 #include "host.h"
 
 
-// protocol setting from the host.  We use exactly the same report
-// either way, so this variable only stores the setting since we
-// are required to be able to report which setting is in use.
-uint8_t usb_keyboard_protocol=1;
-
-// the idle configuration, how often we send the report to the
-// host (ms * 4) even when it hasn't changed
-// Windows and Linux set 0 while OS X sets 6(24ms) by SET_IDLE request.
-uint8_t usb_keyboard_idle_config=125;
-
-// count until idle timeout
-uint8_t usb_keyboard_idle_count=0;
+// HID spec recommends 500ms for keyboard
+usb_keyboard_idle_t usb_keyboard_kbd = { .endpoint = KBD_ENDPOINT, .idle_config = 125 };
+#ifdef NKRO_ENABLE
+usb_keyboard_idle_t usb_keyboard_kbd2 = { .endpoint = KBD2_ENDPOINT, .idle_config = 125 };
+#endif
 
 // 1=num lock, 2=caps lock, 4=scroll lock, 8=compose, 16=kana
 volatile uint8_t usb_keyboard_leds=0;
 
 
-static inline int8_t send_report(report_keyboard_t *report, uint8_t endpoint, uint8_t keys_start, uint8_t keys_end);
+static inline int8_t send_report(report_keyboard_t *report, usb_keyboard_idle_t *kbd, uint8_t len);
+static void write_pending(usb_keyboard_idle_t *kbd);
 
 
 int8_t usb_keyboard_send_report(report_keyboard_t *report)
@@ -56,19 +50,19 @@ int8_t usb_keyboard_send_report(report_keyboard_t *report)
     int8_t result = 0;
 
 #ifdef NKRO_ENABLE
-    if (keyboard_nkro)
-        result = send_report(report, KBD2_ENDPOINT, 0, KBD2_SIZE);
+    if (keyboard_protocol && keyboard_nkro)
+        result = send_report(report, &usb_keyboard_kbd2, KBD2_SIZE);
     else
 #endif
     {
-        if (usb_keyboard_protocol)
-            result = send_report(report, KBD_ENDPOINT, 0, KBD_SIZE);
+        // boot protocol report is 8 bytes
+        if (keyboard_protocol)
+            result = send_report(report, &usb_keyboard_kbd, KBD_SIZE);
         else
-            result = send_report(report, KBD_ENDPOINT, 0, 6);
+            result = send_report(report, &usb_keyboard_kbd, 8);
     }
 
     if (result) return result;
-    usb_keyboard_idle_count = 0;
     usb_keyboard_print_report(report);
     return 0;
 }
@@ -82,32 +76,88 @@ void usb_keyboard_print_report(report_keyboard_t *report)
 }
 
 
-static inline int8_t send_report(report_keyboard_t *report, uint8_t endpoint, uint8_t keys_start, uint8_t keys_end)
+/* Sends report right away if bank is free, otherwise leaves it pending and
+ * SOF interrupt sends it later. Never waits for host. */
+static inline int8_t send_report(report_keyboard_t *report, usb_keyboard_idle_t *kbd, uint8_t len)
 {
-    uint8_t intr_state, timeout;
+    uint8_t intr_state;
 
     if (!usb_configured()) return -1;
+
+    // take back pending buffer, newer report replaces it
     intr_state = SREG;
     cli();
-    UENUM = endpoint;
-    timeout = UDFNUML + 50;
-    while (1) {
-            // are we ready to transmit?
-            if (UEINTX & (1<<RWAL)) break;
-            SREG = intr_state;
-            // has the USB gone offline?
-            if (!usb_configured()) return -1;
-            // have we waited too long?
-            if (UDFNUML == timeout) return -1;
-            // get ready to try checking again
-            intr_state = SREG;
-            cli();
-            UENUM = endpoint;
+    if (kbd->pending) {
+        kbd->pending = 0;
+        kbd->superseded++;
     }
-    for (uint8_t i = keys_start; i < keys_end; i++) {
-            UEDATX = report->raw[i];
+    SREG = intr_state;
+
+    // buffer not in use by interrupt
+    uint8_t *buf = kbd->report[kbd->last ^ 1];
+    for (uint8_t i = 0; i < len; i++) {
+            buf[i] = report->raw[i];
     }
-    UEINTX = 0x3A;
+
+    intr_state = SREG;
+    cli();
+    kbd->pending = len;
+    write_pending(kbd);
     SREG = intr_state;
     return 0;
 }
+
+/* call with interrupt disabled */
+static void write_pending(usb_keyboard_idle_t *kbd)
+{
+    if (!kbd->pending) return;
+
+    UENUM = kbd->endpoint;
+    if (!(UEINTX & (1<<RWAL))) return;
+
+    uint8_t *buf = kbd->report[kbd->last ^ 1];
+    for (uint8_t i = 0; i < kbd->pending; i++) {
+            UEDATX = buf[i];
+    }
+    UEINTX = 0x3A;
+    kbd->last ^= 1;
+    kbd->len = kbd->pending;
+    kbd->pending = 0;
+    kbd->idle_count = 0;
+}
+
+void usb_keyboard_pending_task(void)
+{
+    write_pending(&usb_keyboard_kbd);
+#ifdef NKRO_ENABLE
+    write_pending(&usb_keyboard_kbd2);
+#endif
+}
+
+static inline void idle_resend(usb_keyboard_idle_t *kbd)
+{
+    if (!kbd->idle_config || !kbd->len || kbd->pending) return;
+
+    UENUM = kbd->endpoint;
+    if (UEINTX & (1<<RWAL)) {
+        if (++kbd->idle_count >= kbd->idle_config) {
+            kbd->idle_count = 0;
+            uint8_t *buf = kbd->report[kbd->last];
+            for (uint8_t i = 0; i < kbd->len; i++) {
+                UEDATX = buf[i];
+            }
+            UEINTX = 0x3A;
+        }
+    }
+}
+
+void usb_keyboard_idle_task(void)
+{
+    // only interface in use, the other may hold stale report
+#ifdef NKRO_ENABLE
+    if (keyboard_protocol && keyboard_nkro)
+        idle_resend(&usb_keyboard_kbd2);
+    else
+#endif
+        idle_resend(&usb_keyboard_kbd);
+}
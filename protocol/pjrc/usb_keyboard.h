@@ -30,13 +30,51 @@
 #include "host.h"
 
 
-extern uint8_t usb_keyboard_protocol;
-extern uint8_t usb_keyboard_idle_config;
-extern uint8_t usb_keyboard_idle_count;
+#ifdef NKRO_ENABLE
+#   define USB_KEYBOARD_REPORT_SIZE KBD2_SIZE
+#else
+#   define USB_KEYBOARD_REPORT_SIZE KBD_SIZE
+#endif
+
+/* Idle state of a keyboard interface
+ *
+ * Last sent report is kept in one of two buffers so that SOF interrupt can
+ * resend it at idle rate. Main loop fills the other buffer and switches
+ * 'last' with interrupt disabled when the report is written to endpoint,
+ * interrupt never sees half updated report.
+ *
+ * When endpoint bank is busy the other buffer stays pending and SOF
+ * interrupt sends it once the bank is free. A newer report replaces
+ * pending one, host always gets the latest state.
+ */
+typedef struct {
+    uint8_t endpoint;
+    // how often report is resent (ms * 4), 0 means only on change
+    // Windows and Linux set 0 while OS X sets 6(24ms) by SET_IDLE request.
+    uint8_t idle_config;
+    // count until idle timeout
+    uint8_t idle_count;
+    uint8_t len;
+    uint8_t last;
+    // length of report waiting for free bank, 0 if none
+    uint8_t pending;
+    // pending reports replaced by newer one
+    uint16_t superseded;
+    uint8_t report[2][USB_KEYBOARD_REPORT_SIZE];
+} usb_keyboard_idle_t;
+
+extern usb_keyboard_idle_t usb_keyboard_kbd;
+#ifdef NKRO_ENABLE
+extern usb_keyboard_idle_t usb_keyboard_kbd2;
+#endif
 extern volatile uint8_t usb_keyboard_leds;
 
 
 int8_t usb_keyboard_send_report(report_keyboard_t *report);
 void usb_keyboard_print_report(report_keyboard_t *report);
+/* called from SOF interrupt */
+void usb_keyboard_pending_task(void);
+/* called from SOF interrupt every 4ms */
+void usb_keyboard_idle_task(void);
 
 #endif
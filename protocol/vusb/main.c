@@ -87,12 +87,13 @@ int main(void)
         }
 #endif
         if (!suspended) {
-            usbPoll();
+            vusb_poll();
 
-            // TODO: configuration process is incosistent. it sometime fails.
-            // To prevent failing to configure NOT scan keyboard during configuration
-            if (usbConfiguration && usbInterruptIsReady()) {
+            // NOT scan keyboard during configuration or other control transfer,
+            // long scan delays usbPoll() and fails the transfer.
+            if (vusb_task_ready()) {
                 keyboard_task();
+                vusb_poll();
             }
             vusb_transfer_keyboard();
         }
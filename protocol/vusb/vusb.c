@@ -20,36 +20,474 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "usbconfig.h"
 #include "host.h"
 #include "report.h"
+#include "report_descriptor.h"
+#include "keycode.h"
 #include "print.h"
 #include "debug.h"
 #include "host_driver.h"
+#include "timer.h"
 #include "vusb.h"
 
 
 static uint8_t vusb_keyboard_leds = 0;
 static uint8_t vusb_idle_rate = 0;
 
-/* Keyboard report send buffer */
-#define KBUF_SIZE 16
-static report_keyboard_t kbuf[KBUF_SIZE];
-static uint8_t kbuf_head = 0;
-static uint8_t kbuf_tail = 0;
+/* Keyboard report send queue
+ *
+ * Instead of whole reports the queue holds changes between them: a key
+ * toggled or a mask of mods toggled, two bytes each. Last change of a
+ * report has KD_END flag and transmit side applies changes up to it to its
+ * own key state and renders report from that.
+ *
+ * When the queue is filled over KDELTA_MERGE changes of a new report are
+ * merged into the last report waiting in queue, unless the same key or
+ * mod is changed in it, so press and release of a key are never merged
+ * into one report. Keyboard task is not run until queue gets under
+ * KDELTA_MERGE again, events wait in matrix and tapping buffer meanwhile.
+ *
+ * If reports of one task still don't fit the producer is stalled: USB is
+ * polled and queue transferred until there is room. Only when host stops
+ * taking reports for KDELTA_STALL_TIMEOUT(e.g. suspended) the report is
+ * not queued and whole state is sent once queue gets empty.
+ */
+#ifndef KDELTA_SIZE
+#define KDELTA_SIZE     16
+#endif
+#define KDELTA_MERGE    (KDELTA_SIZE * 3 / 4)
+#ifndef KDELTA_STALL_TIMEOUT
+#define KDELTA_STALL_TIMEOUT    100     // ms
+#endif
+
+/* keys KC_A(0x04)-KC_EXSEL(0xA4) in bitmap */
+#define KEY_BITS        ((KC_EXSEL >> 3) + 1)
+
+#define KD_KEY      0x01
+#define KD_MODS     0x02
+#define KD_NKRO     0x40
+#define KD_END      0x80
+typedef struct {
+    uint8_t kind;
+    uint8_t code;   // keycode or mods mask
+} kdelta_t;
+
+static kdelta_t kdelta[KDELTA_SIZE];
+static uint8_t kdelta_tail = 0;
+static uint8_t kdelta_len = 0;
+static bool kdelta_resync = false;
+static uint16_t kdelta_merged = 0;
+static uint16_t kdelta_stalled = 0;
+static uint16_t kdelta_overflow = 0;
+
+/* state after all changes in queue are applied */
+static uint8_t queued_mods = 0;
+static uint8_t queued_bits[KEY_BITS];
+/* state sent to host */
+static uint8_t sent_mods = 0;
+static uint8_t sent_bits[KEY_BITS];
+
+#define KDELTA_AT(i)    kdelta[(kdelta_tail + (i)) % KDELTA_SIZE]
+
+
+#ifdef NKRO_ENABLE
+/* NKRO report goes to EP3 with report ID. It is longer than low speed
+ * packet size and split into 8-byte chunks, last short chunk ends the transfer.
+ * Nothing else can be sent on EP3 until all the chunks are out. */
+typedef struct {
+    uint8_t report_id;
+    report_keyboard_t report;
+} __attribute__ ((packed)) vusb_nkro_report_t;
+
+static vusb_nkro_report_t nkro_buf = { .report_id = REPORT_ID_NKRO };
+static uint8_t nkro_sent = sizeof(vusb_nkro_report_t);
+
+static bool nkro_transfer(void)
+{
+    if (nkro_sent >= sizeof(nkro_buf)) return false;
+    if (usbInterruptIsReady3()) {
+        uint8_t len = sizeof(nkro_buf) - nkro_sent;
+        if (len > 8) len = 8;
+        usbSetInterrupt3((void *)((uint8_t *)&nkro_buf + nkro_sent), len);
+        nkro_sent += len;
+    }
+    return true;
+}
+
+static inline bool ep3_ready(void)
+{
+    return (!nkro_transfer() && usbInterruptIsReady3());
+}
+#else
+#define ep3_ready() usbInterruptIsReady3()
+#endif
+
+static void transfer_keyboard(void);
+
+
+/* EP3 report queue
+ *
+ * Mouse button, system and consumer reports are queued per report ID so
+ * that none of them is lost while EP3 is busy, a lost release leaves
+ * media key stuck on host. When a queue is full the newest entry is
+ * overwritten, the latest state always reaches host.
+ * Mouse motion is summed up instead and sent only when no button, system
+ * or consumer report is waiting.
+ */
+#ifndef EP3_QUEUE_SIZE
+#define EP3_QUEUE_SIZE  4
+#endif
+
+typedef struct {
+    uint8_t report_id;
+    uint8_t tail;
+    uint8_t len;
+    uint16_t data[EP3_QUEUE_SIZE];
+} ep3_queue_t;
+
+static ep3_queue_t ep3_queues[] = {
+    { .report_id = REPORT_ID_MOUSE },       // buttons
+    { .report_id = REPORT_ID_SYSTEM },
+    { .report_id = REPORT_ID_CONSUMER },
+};
+#define EP3_QUEUE_COUNT (sizeof(ep3_queues) / sizeof(ep3_queues[0]))
+#define MOUSE_QUEUE     (&ep3_queues[0])
+#define SYSTEM_QUEUE    (&ep3_queues[1])
+#define CONSUMER_QUEUE  (&ep3_queues[2])
+
+static uint16_t ep3_overwritten = 0;
+
+/* buttons of last queued mouse report and motion not sent yet */
+static uint8_t mouse_buttons = 0;
+static int16_t mouse_motion[4];     // x, y, v, h
+
+typedef struct {
+    uint8_t report_id;
+    report_mouse_t report;
+} __attribute__ ((packed)) vusb_mouse_report_t;
+
+typedef struct {
+    uint8_t  report_id;
+    uint16_t usage;
+} __attribute__ ((packed)) report_extra_t;
 
+static void ep3_queue_put(ep3_queue_t *q, uint16_t data)
+{
+    if (q->len < EP3_QUEUE_SIZE) {
+        q->len++;
+    } else {
+        ep3_overwritten++;
+    }
+    q->data[(q->tail + q->len - 1) % EP3_QUEUE_SIZE] = data;
+}
+
+static int8_t mouse_motion_take(int16_t *m)
+{
+    int8_t d = (*m > 127 ? 127 : (*m < -127 ? -127 : *m));
+    *m -= d;
+    return d;
+}
+
+static void ep3_transfer(void)
+{
+    if (!ep3_ready()) return;
+
+    for (uint8_t i = 0; i < EP3_QUEUE_COUNT; i++) {
+        ep3_queue_t *q = &ep3_queues[i];
+        if (!q->len) continue;
+
+        uint16_t data = q->data[q->tail];
+        q->tail = (q->tail + 1) % EP3_QUEUE_SIZE;
+        q->len--;
+        if (q == MOUSE_QUEUE) {
+            vusb_mouse_report_t r = {
+                .report_id = REPORT_ID_MOUSE,
+                .report = { .buttons = data }
+            };
+            usbSetInterrupt3((void *)&r, sizeof(r));
+        } else {
+            report_extra_t r = {
+                .report_id = q->report_id,
+                .usage = data
+            };
+            usbSetInterrupt3((void *)&r, sizeof(r));
+        }
+        return;
+    }
+
+    if (mouse_motion[0] || mouse_motion[1] || mouse_motion[2] || mouse_motion[3]) {
+        vusb_mouse_report_t r = {
+            .report_id = REPORT_ID_MOUSE,
+            .report = {
+                .buttons = mouse_buttons,
+                .x = mouse_motion_take(&mouse_motion[0]),
+                .y = mouse_motion_take(&mouse_motion[1]),
+                .v = mouse_motion_take(&mouse_motion[2]),
+                .h = mouse_motion_take(&mouse_motion[3])
+            }
+        };
+        usbSetInterrupt3((void *)&r, sizeof(r));
+    }
+}
+
+uint16_t vusb_ep3_overwritten(void)
+{
+    return ep3_overwritten;
+}
+
+/* render sent_bits and sent_mods into boot report: mods, reserved and 6 keys */
+static void render_boot(uint8_t *r)
+{
+    uint8_t n = 2;
+    r[0] = sent_mods;
+    for (uint8_t i = 1; i < RD_VUSB_KEYBOARD_SIZE; i++) r[i] = 0;
+    for (uint8_t i = 0; i < KEY_BITS && n < RD_VUSB_KEYBOARD_SIZE; i++) {
+        if (!sent_bits[i]) continue;
+        for (uint8_t j = 0; j < 8 && n < RD_VUSB_KEYBOARD_SIZE; j++) {
+            if (sent_bits[i] & (1<<j)) r[n++] = i<<3 | j;
+        }
+    }
+}
+
+#ifdef NKRO_ENABLE
+static void render_nkro(vusb_nkro_report_t *r)
+{
+    r->report_id = REPORT_ID_NKRO;
+    r->report = (report_keyboard_t){};
+    r->report.nkro.mods = sent_mods;
+    for (uint8_t i = 0; i < KEY_BITS && i < REPORT_BITS; i++) {
+        r->report.nkro.bits[i] = sent_bits[i];
+    }
+}
+#endif
+
+/* send sent_bits and sent_mods to host */
+static void send_state(bool nkro)
+{
+#ifdef NKRO_ENABLE
+    if (nkro) {
+        render_nkro(&nkro_buf);
+        nkro_sent = 0;
+        nkro_transfer();
+        return;
+    }
+#endif
+    uint8_t r[RD_VUSB_KEYBOARD_SIZE];
+    render_boot(r);
+    usbSetInterrupt(r, sizeof(r));
+}
 
-/* transfer keyboard report from buffer */
+/* transfer keyboard report from buffer, and then EP3 reports */
 void vusb_transfer_keyboard(void)
 {
-    if (usbInterruptIsReady()) {
-        if (kbuf_head != kbuf_tail) {
-            usbSetInterrupt((void *)&kbuf[kbuf_tail], sizeof(report_keyboard_t));
-            kbuf_tail = (kbuf_tail + 1) % KBUF_SIZE;
-            if (debug_keyboard) {
-                print("V-USB: kbuf["); pdec(kbuf_tail); print("->"); pdec(kbuf_head); print("](");
-                phex((kbuf_head < kbuf_tail) ? (KBUF_SIZE - kbuf_tail + kbuf_head) : (kbuf_head - kbuf_tail));
-                print(")\n");
+    transfer_keyboard();
+    ep3_transfer();
+}
+
+static void transfer_keyboard(void)
+{
+#ifdef NKRO_ENABLE
+    // keep order: previous report must be out before next one
+    if (nkro_transfer()) return;
+    bool nkro = kdelta_len ? (KDELTA_AT(0).kind & KD_NKRO) : (keyboard_protocol && keyboard_nkro);
+    if (!(nkro ? usbInterruptIsReady3() : usbInterruptIsReady())) return;
+#else
+    bool nkro = false;
+    if (!usbInterruptIsReady()) return;
+#endif
+
+    if (kdelta_len) {
+        kdelta_t d;
+        do {
+            d = KDELTA_AT(0);
+            if (d.kind & KD_KEY)  sent_bits[d.code>>3] ^= (1<<(d.code & 7));
+            if (d.kind & KD_MODS) sent_mods ^= d.code;
+            kdelta_tail = (kdelta_tail + 1) % KDELTA_SIZE;
+            kdelta_len--;
+        } while (!(d.kind & KD_END));
+        send_state(nkro);
+        if (debug_keyboard) {
+            print("V-USB: kdelta("); pdec(kdelta_len); print(")\n");
+        }
+    } else if (kdelta_resync) {
+        kdelta_resync = false;
+        sent_mods = queued_mods;
+        for (uint8_t i = 0; i < KEY_BITS; i++) sent_bits[i] = queued_bits[i];
+        send_state(nkro);
+    }
+}
+
+/* true when change of the key or mods is queued in the last report */
+static bool kdelta_in_last(uint8_t kind, uint8_t code)
+{
+    for (uint8_t i = kdelta_len; i--; ) {
+        kdelta_t d = KDELTA_AT(i);
+        if (i != kdelta_len - 1 && (d.kind & KD_END)) break;
+        if ((kind & d.kind & KD_KEY) && d.code == code) return true;
+        if ((kind & d.kind & KD_MODS) && (d.code & code)) return true;
+    }
+    return false;
+}
+
+/* polls USB and transfers queued reports until `n` entries are free */
+static bool kdelta_wait(uint8_t n)
+{
+    uint16_t t = timer_read();
+    while (kdelta_len + n > KDELTA_SIZE) {
+        if (timer_elapsed(t) > KDELTA_STALL_TIMEOUT) return false;
+        vusb_poll();
+        transfer_keyboard();
+    }
+    return true;
+}
+
+static void kdelta_queue(report_keyboard_t *report, bool nkro)
+{
+    uint8_t bits[KEY_BITS] = {};
+#ifdef NKRO_ENABLE
+    if (nkro) {
+        for (uint8_t i = 0; i < KEY_BITS && i < REPORT_BITS; i++) {
+            bits[i] = report->nkro.bits[i];
+        }
+    } else
+#endif
+    {
+        for (uint8_t i = 0; i < REPORT_KEYS; i++) {
+            uint8_t code = report->keys[i];
+            if (code && code <= KC_EXSEL) bits[code>>3] |= (1<<(code & 7));
+        }
+    }
+
+    // count changes and see if they can be merged into the last report
+    uint8_t mods = report->mods ^ queued_mods;
+    uint8_t flags = (nkro ? KD_NKRO : 0);
+    uint8_t n;
+    bool merge;
+    bool stalled = false;
+    do {
+        n = (mods ? 1 : 0);
+        merge = (kdelta_len >= KDELTA_MERGE &&
+                 !!(KDELTA_AT(kdelta_len - 1).kind & KD_NKRO) == nkro &&
+                 !(mods && kdelta_in_last(KD_MODS, mods)));
+        for (uint8_t i = 0; i < KEY_BITS; i++) {
+            uint8_t x = bits[i] ^ queued_bits[i];
+            for (uint8_t j = 0; x; j++, x >>= 1) {
+                if (!(x & 1)) continue;
+                n++;
+                if (merge && kdelta_in_last(KD_KEY, i<<3 | j)) merge = false;
             }
         }
+        if (!n && merge) return;
+
+        // report with no change, e.g. after protocol change, takes an entry too
+        if (stalled || kdelta_resync || kdelta_len + (n ? n : 1) <= KDELTA_SIZE) break;
+
+        // hold producer until host takes reports, last one may be sent by then
+        kdelta_stalled++;
+        debug("kdelta: stall\n");
+        stalled = true;
+        if (!kdelta_wait(n ? n : 1)) break;
+    } while (1);
+
+    if (kdelta_resync || kdelta_len + (n ? n : 1) > KDELTA_SIZE) {
+        // host will get whole state after queue is sent
+        if (!kdelta_resync) {
+            kdelta_overflow++;
+            debug("kdelta: full\n");
+        }
+        kdelta_resync = true;
+    } else {
+        if (merge) {
+            KDELTA_AT(kdelta_len - 1).kind &= ~KD_END;
+            kdelta_merged++;
+        }
+        if (!n) {
+            KDELTA_AT(kdelta_len++) = (kdelta_t){ .kind = flags };
+        }
+        if (mods) {
+            KDELTA_AT(kdelta_len++) = (kdelta_t){ .kind = KD_MODS | flags, .code = mods };
+        }
+        for (uint8_t i = 0; i < KEY_BITS; i++) {
+            uint8_t x = bits[i] ^ queued_bits[i];
+            for (uint8_t j = 0; x; j++, x >>= 1) {
+                if (!(x & 1)) continue;
+                KDELTA_AT(kdelta_len++) = (kdelta_t){ .kind = KD_KEY | flags, .code = i<<3 | j };
+            }
+        }
+        KDELTA_AT(kdelta_len - 1).kind |= KD_END;
+    }
+
+    queued_mods = report->mods;
+    for (uint8_t i = 0; i < KEY_BITS; i++) queued_bits[i] = bits[i];
+}
+
+uint16_t vusb_kdelta_merged(void)
+{
+    return kdelta_merged;
+}
+
+uint16_t vusb_kdelta_stalled(void)
+{
+    return kdelta_stalled;
+}
+
+uint16_t vusb_kdelta_overflow(void)
+{
+    return kdelta_overflow;
+}
+
+
+/*------------------------------------------------------------------*
+ * Scheduler
+ *------------------------------------------------------------------*/
+/* from usbdrv.c: length of received packet not processed yet, and
+ * byte count of pending control IN data or handshake PID */
+extern volatile schar usbRxLen;
+extern volatile uchar usbTxLen;
+
+static vusb_sched_stat_t sched_stat;
+static uint16_t poll_last = 0;
+static bool poll_started = false;
+static uint16_t control_last = 0;
+static bool control_holding = false;
+
+void vusb_poll(void)
+{
+    uint16_t now = timer_read();
+    if (poll_started) {
+        uint16_t elapsed = TIMER_DIFF_16(now, poll_last);
+        if (elapsed > sched_stat.max) sched_stat.max = elapsed;
+        if (elapsed > VUSB_POLL_DEADLINE) sched_stat.missed++;
+    }
+    poll_started = true;
+    poll_last = now;
+
+    // received SETUP/OUT packet, or data stage not finished yet.
+    // handshake PIDs have bit 4 set while data lengths don't.
+    bool control = (usbRxLen > 0 || !(usbTxLen & 0x10));
+
+    usbPoll();
+
+    if (control) {
+        if (!control_holding) sched_stat.held++;
+        control_holding = true;
+        control_last = now;
+    }
+}
+
+bool vusb_task_ready(void)
+{
+    if (!usbConfiguration) return false;
+    if (control_holding) {
+        if (timer_elapsed(control_last) < VUSB_CONTROL_HOLDOFF) return false;
+        control_holding = false;
     }
+    // keyboard report buffer drains only as fast as host polls, leave
+    // events unprocessed while queue is backed up rather than merge them
+    return usbInterruptIsReady() && kdelta_len < KDELTA_MERGE;
+}
+
+const vusb_sched_stat_t *vusb_sched_stat(void)
+{
+    return &sched_stat;
 }
 
 
@@ -81,55 +519,43 @@ static uint8_t keyboard_leds(void) {
 
 static void send_keyboard(report_keyboard_t *report)
 {
-    uint8_t next = (kbuf_head + 1) % KBUF_SIZE;
-    if (next != kbuf_tail) {
-        kbuf[kbuf_head] = *report;
-        kbuf_head = next;
-    } else {
-        debug("kbuf: full\n");
-    }
+#ifdef NKRO_ENABLE
+    kdelta_queue(report, keyboard_protocol && keyboard_nkro);
+#else
+    kdelta_queue(report, false);
+#endif
 
     // NOTE: send key strokes of Macro
-    usbPoll();
+    vusb_poll();
     vusb_transfer_keyboard();
 }
 
 
-typedef struct {
-    uint8_t report_id;
-    report_mouse_t report;
-} __attribute__ ((packed)) vusb_mouse_report_t;
-
 static void send_mouse(report_mouse_t *report)
 {
-    vusb_mouse_report_t r = {
-        .report_id = REPORT_ID_MOUSE,
-        .report = *report
-    };
-    if (usbInterruptIsReady3()) {
-        usbSetInterrupt3((void *)&r, sizeof(vusb_mouse_report_t));
+    if (report->buttons != mouse_buttons) {
+        mouse_buttons = report->buttons;
+        ep3_queue_put(MOUSE_QUEUE, mouse_buttons);
     }
+    int8_t d[4] = { report->x, report->y, report->v, report->h };
+    for (uint8_t i = 0; i < 4; i++) {
+        int16_t m = mouse_motion[i] + d[i];
+        // saturate, motion this large can't be caught up anyway
+        if (m > 1000) m = 1000;
+        if (m < -1000) m = -1000;
+        mouse_motion[i] = m;
+    }
+    ep3_transfer();
 }
 
-
-typedef struct {
-    uint8_t  report_id;
-    uint16_t usage;
-} __attribute__ ((packed)) report_extra_t;
-
 static void send_system(uint16_t data)
 {
     static uint16_t last_data = 0;
     if (data == last_data) return;
     last_data = data;
 
-    report_extra_t report = {
-        .report_id = REPORT_ID_SYSTEM,
-        .usage = data
-    };
-    if (usbInterruptIsReady3()) {
-        usbSetInterrupt3((void *)&report, sizeof(report));
-    }
+    ep3_queue_put(SYSTEM_QUEUE, data);
+    ep3_transfer();
 }
 
 static void send_consumer(uint16_t data)
@@ -138,13 +564,8 @@ static void send_consumer(uint16_t data)
     if (data == last_data) return;
     last_data = data;
 
-    report_extra_t report = {
-        .report_id = REPORT_ID_CONSUMER,
-        .usage = data
-    };
-    if (usbInterruptIsReady3()) {
-        usbSetInterrupt3((void *)&report, sizeof(report));
-    }
+    ep3_queue_put(CONSUMER_QUEUE, data);
+    ep3_transfer();
 }
 
 
@@ -152,6 +573,12 @@ static void send_consumer(uint16_t data)
 /*------------------------------------------------------------------*
  * Request from host                                                *
  *------------------------------------------------------------------*/
+/* USB_RESET_HOOK: device is back to default state after bus reset */
+void vusb_bus_reset(void)
+{
+    keyboard_protocol = 1;
+}
+
 static struct {
     uint16_t        len;
     enum {
@@ -160,6 +587,19 @@ static struct {
     }               kind;
 } last_req;
 
+/* GET_REPORT reply, rendered from state sent to host. keyboard_report can't
+ * be used as it is, in NKRO mode its bytes are bitmap. */
+#ifdef NKRO_ENABLE
+static union {
+    uint8_t boot[RD_VUSB_KEYBOARD_SIZE];
+    vusb_nkro_report_t nkro;
+} get_report_buf;
+#else
+static struct {
+    uint8_t boot[RD_VUSB_KEYBOARD_SIZE];
+} get_report_buf;
+#endif
+
 usbMsgLen_t usbFunctionSetup(uchar data[8])
 {
 usbRequest_t    *rq = (void *)data;
@@ -167,9 +607,17 @@ usbRequest_t    *rq = (void *)data;
     if((rq->bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_CLASS){    /* class request type */
         if(rq->bRequest == USBRQ_HID_GET_REPORT){
             debug("GET_REPORT:");
-            /* we only have one report type, so don't look at wValue */
-            usbMsgPtr = (void *)keyboard_report;
-            return sizeof(*keyboard_report);
+#ifdef NKRO_ENABLE
+            // Report Type: 0x01(Input)/ReportID: NKRO && Interface: 1(EP3)
+            if (rq->wValue.word == (0x0100 | REPORT_ID_NKRO) && rq->wIndex.word == 1) {
+                render_nkro(&get_report_buf.nkro);
+                usbMsgPtr = (void *)&get_report_buf.nkro;
+                return sizeof(vusb_nkro_report_t);
+            }
+#endif
+            render_boot(get_report_buf.boot);
+            usbMsgPtr = (void *)get_report_buf.boot;
+            return RD_VUSB_KEYBOARD_SIZE;   // boot report
         }else if(rq->bRequest == USBRQ_HID_GET_IDLE){
             debug("GET_IDLE: ");
             //debug_hex(vusb_idle_rate);
@@ -179,6 +627,14 @@ usbRequest_t    *rq = (void *)data;
             vusb_idle_rate = rq->wValue.bytes[1];
             debug("SET_IDLE: ");
             debug_hex(vusb_idle_rate);
+        }else if(rq->bRequest == USBRQ_HID_GET_PROTOCOL){
+            debug("GET_PROTOCOL: ");
+            usbMsgPtr = (void *)&keyboard_protocol;
+            return 1;
+        }else if(rq->bRequest == USBRQ_HID_SET_PROTOCOL){
+            keyboard_protocol = rq->wValue.bytes[0];
+            debug("SET_PROTOCOL: ");
+            debug_hex(keyboard_protocol);
         }else if(rq->bRequest == USBRQ_HID_SET_REPORT){
             debug("SET_REPORT: ");
             // Report Type: 0x02(Out)/ReportID: 0x00(none) && Interface: 0(keyboard)
@@ -227,128 +683,13 @@ uchar usbFunctionWrite(uchar *data, uchar len)
  * Descriptors                                                      *
  *------------------------------------------------------------------*/
 
-/*
- * Report Descriptor for keyboard
- *
- * from an example in HID spec appendix
- */
 PROGMEM uchar keyboard_hid_report[] = {
-    0x05, 0x01,          // Usage Page (Generic Desktop),
-    0x09, 0x06,          // Usage (Keyboard),
-    0xA1, 0x01,          // Collection (Application),
-    0x75, 0x01,          //   Report Size (1),
-    0x95, 0x08,          //   Report Count (8),
-    0x05, 0x07,          //   Usage Page (Key Codes),
-    0x19, 0xE0,          //   Usage Minimum (224),
-    0x29, 0xE7,          //   Usage Maximum (231),
-    0x15, 0x00,          //   Logical Minimum (0),
-    0x25, 0x01,          //   Logical Maximum (1),
-    0x81, 0x02,          //   Input (Data, Variable, Absolute), ;Modifier byte
-    0x95, 0x01,          //   Report Count (1),
-    0x75, 0x08,          //   Report Size (8),
-    0x81, 0x03,          //   Input (Constant),                 ;Reserved byte
-    0x95, 0x05,          //   Report Count (5),
-    0x75, 0x01,          //   Report Size (1),
-    0x05, 0x08,          //   Usage Page (LEDs),
-    0x19, 0x01,          //   Usage Minimum (1),
-    0x29, 0x05,          //   Usage Maximum (5),
-    0x91, 0x02,          //   Output (Data, Variable, Absolute), ;LED report
-    0x95, 0x01,          //   Report Count (1),
-    0x75, 0x03,          //   Report Size (3),
-    0x91, 0x03,          //   Output (Constant),                 ;LED report padding
-    0x95, 0x06,          //   Report Count (6),
-    0x75, 0x08,          //   Report Size (8),
-    0x15, 0x00,          //   Logical Minimum (0),
-    0x25, 0xFF,          //   Logical Maximum(255),
-    0x05, 0x07,          //   Usage Page (Key Codes),
-    0x19, 0x00,          //   Usage Minimum (0),
-    0x29, 0xFF,          //   Usage Maximum (255),
-    0x81, 0x00,          //   Input (Data, Array),
-    0xc0                 // End Collection
+    RD_VUSB_KEYBOARD
 };
 
-/*
- * Report Descriptor for mouse
- *
- * Mouse Protocol 1, HID 1.11 spec, Appendix B, page 59-60, with wheel extension
- * http://www.microchip.com/forums/tm.aspx?high=&m=391435&mpage=1#391521
- * http://www.keil.com/forum/15671/
- * http://www.microsoft.com/whdc/device/input/wheel.mspx
- */
+/* Report Descriptor for EP3: mouse, system, consumer and NKRO keyboard */
 PROGMEM uchar mouse_hid_report[] = {
-    /* mouse */
-    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
-    0x09, 0x02,                    // USAGE (Mouse)
-    0xa1, 0x01,                    // COLLECTION (Application)
-    0x85, REPORT_ID_MOUSE,         //   REPORT_ID (1)
-    0x09, 0x01,                    //   USAGE (Pointer)
-    0xa1, 0x00,                    //   COLLECTION (Physical)
-                                   // ----------------------------  Buttons
-    0x05, 0x09,                    //     USAGE_PAGE (Button)
-    0x19, 0x01,                    //     USAGE_MINIMUM (Button 1)
-    0x29, 0x05,                    //     USAGE_MAXIMUM (Button 5)
-    0x15, 0x00,                    //     LOGICAL_MINIMUM (0)
-    0x25, 0x01,                    //     LOGICAL_MAXIMUM (1)
-    0x75, 0x01,                    //     REPORT_SIZE (1)
-    0x95, 0x05,                    //     REPORT_COUNT (5)
-    0x81, 0x02,                    //     INPUT (Data,Var,Abs)
-    0x75, 0x03,                    //     REPORT_SIZE (3)
-    0x95, 0x01,                    //     REPORT_COUNT (1)
-    0x81, 0x03,                    //     INPUT (Cnst,Var,Abs)
-                                   // ----------------------------  X,Y position
-    0x05, 0x01,                    //     USAGE_PAGE (Generic Desktop)
-    0x09, 0x30,                    //     USAGE (X)
-    0x09, 0x31,                    //     USAGE (Y)
-    0x15, 0x81,                    //     LOGICAL_MINIMUM (-127)
-    0x25, 0x7f,                    //     LOGICAL_MAXIMUM (127)
-    0x75, 0x08,                    //     REPORT_SIZE (8)
-    0x95, 0x02,                    //     REPORT_COUNT (2)
-    0x81, 0x06,                    //     INPUT (Data,Var,Rel)
-                                   // ----------------------------  Vertical wheel
-    0x09, 0x38,                    //     USAGE (Wheel)
-    0x15, 0x81,                    //     LOGICAL_MINIMUM (-127)
-    0x25, 0x7f,                    //     LOGICAL_MAXIMUM (127)
-    0x35, 0x00,                    //     PHYSICAL_MINIMUM (0)        - reset physical
-    0x45, 0x00,                    //     PHYSICAL_MAXIMUM (0)
-    0x75, 0x08,                    //     REPORT_SIZE (8)
-    0x95, 0x01,                    //     REPORT_COUNT (1)
-    0x81, 0x06,                    //     INPUT (Data,Var,Rel)
-                                   // ----------------------------  Horizontal wheel
-    0x05, 0x0c,                    //     USAGE_PAGE (Consumer Devices)
-    0x0a, 0x38, 0x02,              //     USAGE (AC Pan)
-    0x15, 0x81,                    //     LOGICAL_MINIMUM (-127)
-    0x25, 0x7f,                    //     LOGICAL_MAXIMUM (127)
-    0x75, 0x08,                    //     REPORT_SIZE (8)
-    0x95, 0x01,                    //     REPORT_COUNT (1)
-    0x81, 0x06,                    //     INPUT (Data,Var,Rel)
-    0xc0,                          //   END_COLLECTION
-    0xc0,                          // END_COLLECTION
-    /* system control */
-    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
-    0x09, 0x80,                    // USAGE (System Control)
-    0xa1, 0x01,                    // COLLECTION (Application)
-    0x85, REPORT_ID_SYSTEM,        //   REPORT_ID (2)
-    0x15, 0x01,                    //   LOGICAL_MINIMUM (0x1)
-    0x25, 0xb7,                    //   LOGICAL_MAXIMUM (0xb7)
-    0x19, 0x01,                    //   USAGE_MINIMUM (0x1)
-    0x29, 0xb7,                    //   USAGE_MAXIMUM (0xb7)
-    0x75, 0x10,                    //   REPORT_SIZE (16)
-    0x95, 0x01,                    //   REPORT_COUNT (1)
-    0x81, 0x00,                    //   INPUT (Data,Array,Abs)
-    0xc0,                          // END_COLLECTION
-    /* consumer */
-    0x05, 0x0c,                    // USAGE_PAGE (Consumer Devices)
-    0x09, 0x01,                    // USAGE (Consumer Control)
-    0xa1, 0x01,                    // COLLECTION (Application)
-    0x85, REPORT_ID_CONSUMER,      //   REPORT_ID (3)
-    0x15, 0x01,                    //   LOGICAL_MINIMUM (0x1)
-    0x26, 0x9c, 0x02,              //   LOGICAL_MAXIMUM (0x29c)
-    0x19, 0x01,                    //   USAGE_MINIMUM (0x1)
-    0x2a, 0x9c, 0x02,              //   USAGE_MAXIMUM (0x29c)
-    0x75, 0x10,                    //   REPORT_SIZE (16)
-    0x95, 0x01,                    //   REPORT_COUNT (1)
-    0x81, 0x00,                    //   INPUT (Data,Array,Abs)
-    0xc0,                          // END_COLLECTION
+    RD_VUSB_EP3
 };
 
 
@@ -18,10 +18,52 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef VUSB_H
 #define VUSB_H
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "host_driver.h"
 
 
+/* usbPoll() interval in ms counted as missed deadline.
+ * V-USB requires 50ms at most, control transfer needs it much shorter. */
+#ifndef VUSB_POLL_DEADLINE
+#define VUSB_POLL_DEADLINE      10
+#endif
+
+/* ms to hold off keyboard task after control transfer activity */
+#ifndef VUSB_CONTROL_HOLDOFF
+#define VUSB_CONTROL_HOLDOFF    20
+#endif
+
+typedef struct {
+    uint16_t missed;    // usbPoll() intervals over VUSB_POLL_DEADLINE
+    uint16_t max;       // longest usbPoll() interval in ms
+    uint16_t held;      // times keyboard task was held off for control transfer
+} vusb_sched_stat_t;
+
+
 host_driver_t *vusb_driver(void);
 void vusb_transfer_keyboard(void);
+/* keyboard reports merged into previous one, sent after waiting for room
+ * in queue, and not queued because host didn't take them in time */
+uint16_t vusb_kdelta_merged(void);
+uint16_t vusb_kdelta_stalled(void);
+uint16_t vusb_kdelta_overflow(void);
+/* mouse button, system and consumer reports overwritten in full queue */
+uint16_t vusb_ep3_overwritten(void);
+
+/* Cooperative scheduler
+ *
+ * Call vusb_poll() instead of usbPoll() so that intervals are measured.
+ * vusb_task_ready() tells main loop whether keyboard task can run now:
+ * not until device is configured, nor while host is doing control
+ * transfer, that is when usbPoll() deadline is tight, nor while keyboard
+ * report queue is backed up.
+ */
+void vusb_poll(void);
+bool vusb_task_ready(void);
+const vusb_sched_stat_t *vusb_sched_stat(void);
+
+/* called from USB_RESET_HOOK of usbconfig.h at end of bus reset */
+void vusb_bus_reset(void);
 
 #endif
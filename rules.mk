@@ -258,6 +258,10 @@ LDFLAGS += $(EXTMEMOPTS)
 LDFLAGS += $(patsubst %,-L%,$(EXTRALIBDIRS))
 LDFLAGS += $(PRINTF_LIB) $(SCANF_LIB) $(MATH_LIB)
 #LDFLAGS += -T linker_script.x
+ifdef TRACE_ENABLE
+# .trace_fmt of common/trace.h takes no flash
+LDFLAGS += -Wl,-T,$(TOP_DIR)/common/trace.ld
+endif
 # You can give EXTRALDFLAGS at 'make' command line.
 LDFLAGS += $(EXTRALDFLAGS)
 
@@ -597,6 +601,12 @@ show_path:
 	@echo VPATH=$(VPATH)
 	@echo SRC=$(SRC)
 
+# Check HID report descriptors against report structs on host
+HOSTCC ?= cc
+hid_check:
+	$(HOSTCC) $(OPT_DEFS) $(if $(CONFIG_H),-include $(CONFIG_H)) -I$(TOP_DIR)/common -o $(OBJDIR)/hid_check $(TOP_DIR)/tool/hid_check.c
+	$(OBJDIR)/hid_check
+
 
 # Create object files directory
 $(shell mkdir $(OBJDIR) 2>/dev/null)
@@ -609,5 +619,5 @@ $(shell mkdir $(OBJDIR) 2>/dev/null)
 # Listing of phony targets.
 .PHONY : all begin finish end sizebefore sizeafter gccversion \
 build elf hex eep lss sym coff extcoff \
-clean clean_list debug gdb-config show_path \
+clean clean_list debug gdb-config show_path hid_check \
 program teensy dfu flip dfu-ee flip-ee dfu-start
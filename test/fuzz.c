@@ -0,0 +1,232 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Fuzz target of action engine
+ *
+ * Input is read as pairs of bytes, first selects a key of keymap.c and toggles
+ * it, second is milli-seconds to wait before the toggle. Keys still down at
+ * end of input are released. Invariants are checked after every scan:
+ *
+ *   - waiting_buffer holds less than WAITING_BUFFER_SIZE events
+ *   - host never receives same keyboard report twice in a row
+ *   - a scan sends no more reports than its events can make
+ *   - once all keys are up and engine settled, report is empty
+ *
+ * Built with libFuzzer(clang -fsanitize=fuzzer) this file is the target as is.
+ * Otherwise it has main() which runs files given as arguments, usable with
+ * AFL as `afl-fuzz -i in -o out obj/fuzz @@`, or random inputs without them:
+ *
+ *   $ fuzz [-n count] [-s seed] [file...]
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "keyboard.h"
+#include "action.h"
+#include "action_layer.h"
+#include "action_macro.h"
+#include "action_oneshot.h"
+#include "host.h"
+#include "host_driver.h"
+#include "test_host.h"
+
+/* waiting_buffer and tapping_key are static */
+#include "action_tapping.c"
+
+
+/* tapping term and macros of keymap.c in full queue, one playing and
+ * MACRO_QUEUE_SIZE-1 waiting, a macro takes less than 200ms.
+ * seed/macro_full.bin fills the queue. */
+#define SETTLE_TIME     (TAPPING_TERM * 2 + (MACRO_QUEUE_SIZE + 1) * 200)
+/* a scan processes an event and replays waiting_buffer, each can send
+ * report of release before press */
+#define MAX_SCAN_REPORTS    (2 * (WAITING_BUFFER_SIZE + 1))
+
+#define FAIL(...) do { \
+    fprintf(stderr, "%lu: ", (unsigned long)test_time); \
+    fprintf(stderr, __VA_ARGS__); \
+    fprintf(stderr, "\n"); \
+    abort(); \
+} while (0)
+
+
+static report_keyboard_t last_report;
+static bool last_report_valid = false;
+static unsigned scan_reports = 0;
+
+
+static uint8_t keyboard_leds(void) { return 0; }
+
+static void send_keyboard(report_keyboard_t *report)
+{
+    if (last_report_valid && memcmp(&last_report, report, sizeof(last_report)) == 0) {
+        FAIL("same report sent again");
+    }
+    last_report = *report;
+    last_report_valid = true;
+    scan_reports++;
+}
+
+static void send_mouse(report_mouse_t *report) {}
+static void send_system(uint16_t data) {}
+static void send_consumer(uint16_t data) {}
+
+static host_driver_t checker = {
+    keyboard_leds,
+    send_keyboard,
+    send_mouse,
+    send_system,
+    send_consumer
+};
+
+
+static bool report_empty(void)
+{
+    if (!last_report_valid) return true;
+    for (uint8_t i = 0; i < sizeof(last_report); i++) {
+        if (last_report.raw[i]) return false;
+    }
+    return true;
+}
+
+static void scan(keyevent_t event)
+{
+    scan_reports = 0;
+    test_task(event);
+
+    uint8_t waiting = (waiting_buffer_head + WAITING_BUFFER_SIZE - waiting_buffer_tail) % WAITING_BUFFER_SIZE;
+    if (waiting >= WAITING_BUFFER_SIZE) {
+        FAIL("waiting_buffer: %u events", waiting);
+    }
+    if (scan_reports > MAX_SCAN_REPORTS) {
+        FAIL("%u reports in a scan", scan_reports);
+    }
+}
+
+/* runs scans for `ms` milli-seconds, `idle` is time since all keys are up */
+static void wait(uint16_t ms, uint32_t *idle)
+{
+    while (ms--) {
+        test_time++;
+        scan(NOEVENT);
+        if (idle && ++*idle > SETTLE_TIME && !report_empty()) {
+            FAIL("keys stuck after all released");
+        }
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static bool initialized = false;
+    uint8_t down[MATRIX_ROWS] = {};
+    uint8_t down_count = 0;
+    uint32_t idle = 0;
+
+    if (!initialized) {
+        host_set_driver(&checker);
+        initialized = true;
+    }
+
+    for (size_t i = 0; i + 1 < size; i += 2) {
+        uint8_t row = (data[i] >> 3) % MATRIX_ROWS;
+        uint8_t col = data[i] % MATRIX_COLS;
+
+        wait(data[i + 1], down_count ? NULL : &idle);
+
+        bool pressed = !(down[row] & (1<<col));
+        down[row] ^= (1<<col);
+        down_count += pressed ? 1 : -1;
+        idle = 0;
+
+        scan((keyevent_t){ .key = (key_t){ .row = row, .col = col }, .pressed = pressed, .time = 1 });
+    }
+
+    // release all
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            if (!(down[row] & (1<<col))) continue;
+            wait(1, NULL);
+            scan((keyevent_t){ .key = (key_t){ .row = row, .col = col }, .pressed = false, .time = 1 });
+        }
+    }
+    idle = 0;
+    wait(SETTLE_TIME + 1, &idle);
+
+    // layer toggled by Fn4 is not stuck, start next input from clean state
+    layer_clear();
+    oneshot_cancel();
+    return 0;
+}
+
+
+#ifndef FUZZ_LIBFUZZER
+static int run_file(const char *path)
+{
+    static uint8_t data[1<<16];
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    size_t size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+    LLVMFuzzerTestOneInput(data, size);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long count = 10000;
+    unsigned long seed = 1;
+    int i = 1;
+
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            count = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            seed = strtoul(argv[i + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "usage: %s [-n count] [-s seed] [file...]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (i < argc) {
+        int status = 0;
+        for (; i < argc; i++) {
+            status |= run_file(argv[i]);
+        }
+        return status;
+    }
+
+    srand(seed);
+    for (unsigned long n = 0; n < count; n++) {
+        uint8_t data[256];
+        size_t size = rand() % sizeof(data);
+        for (size_t k = 0; k < size; k++) {
+            // keep waits mostly short so that events pile up in tapping term
+            data[k] = (k & 1) ? rand() % ((rand() & 3) ? 32 : 256) : rand();
+        }
+        LLVMFuzzerTestOneInput(data, size);
+    }
+    printf("fuzz: %lu inputs OK\n", count);
+    return 0;
+}
+#endif
@@ -0,0 +1,180 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Heavy rollover on host.c: presses more keys than a report holds and
+ * releases them from the head of the key list, where every release shifts
+ * the rest of the list, and from the tail. Each report is checked against
+ * keys pressed and cost per call is printed.
+ *
+ *   $ host_bench 1000      # rounds of rollover
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "keycode.h"
+#include "host.h"
+#include "host_driver.h"
+
+
+/* keys pressed at once, more than key list holds */
+#define ROLLOVER    (REPORT_KEYS + 8)
+
+static report_keyboard_t sent;
+
+static uint8_t keyboard_leds(void) { return 0; }
+static void send_keyboard(report_keyboard_t *report) { sent = *report; }
+static void send_mouse(report_mouse_t *report) {}
+static void send_system(uint16_t data) {}
+static void send_consumer(uint16_t data) {}
+
+static host_driver_t recorder = {
+    keyboard_leds,
+    send_keyboard,
+    send_mouse,
+    send_system,
+    send_consumer
+};
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+typedef struct {
+    uint64_t ns, max;
+    unsigned long calls;
+} cost_t;
+
+static bool pressed[ROLLOVER];
+
+static bool nkro_mode(void)
+{
+#ifdef NKRO_ENABLE
+    return keyboard_protocol && keyboard_nkro;
+#else
+    return false;
+#endif
+}
+
+/* keys pressed in order of keycode, list is full after REPORT_KEYS of them */
+static bool check(void)
+{
+    report_keyboard_t expect = {};
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < ROLLOVER; i++) {
+        if (!pressed[i]) continue;
+        uint8_t key = KC_A + i;
+#ifdef NKRO_ENABLE
+        if (nkro_mode()) {
+            expect.nkro.bits[key>>3] |= 1<<(key&7);
+            n++;
+            continue;
+        }
+#endif
+        expect.keys[n++] = key;
+    }
+    if (host_has_anykey() != n || memcmp(&expect, &sent, sizeof(sent))) {
+        fprintf(stderr, "host_bench: report differs with %u keys pressed\n", n);
+        return false;
+    }
+    return true;
+}
+
+/* one call and the flush of keyboard_task() after it */
+static bool step(uint8_t i, bool press, cost_t *cost)
+{
+    uint64_t t = now_ns();
+    if (press) {
+        host_add_key(KC_A + i);
+    } else {
+        host_del_key(KC_A + i);
+    }
+    host_send_keyboard_report();
+    host_flush_keyboard_report();
+    t = now_ns() - t;
+    cost->ns += t;
+    if (t > cost->max) cost->max = t;
+    cost->calls++;
+
+    if (press) {
+        // key over full list is ignored unless NKRO
+        uint8_t n = 0;
+        for (uint8_t j = 0; j < ROLLOVER; j++) n += pressed[j];
+        pressed[i] = (nkro_mode() || n < REPORT_KEYS);
+    } else {
+        pressed[i] = false;
+    }
+    return check();
+}
+
+static void print_cost(const char *name, const cost_t *cost)
+{
+    printf(" %s %lu (max %lu)", name,
+           (unsigned long)(cost->calls ? cost->ns / cost->calls : 0),
+           (unsigned long)cost->max);
+}
+
+static bool bench(const char *mode, unsigned long rounds)
+{
+    cost_t add = {}, del_head = {}, del_tail = {};
+
+    for (unsigned long r = 0; r < rounds; r++) {
+        for (uint8_t i = 0; i < ROLLOVER; i++) {
+            if (!step(i, true, &add)) return false;
+        }
+        for (uint8_t i = 0; i < ROLLOVER; i++) {
+            if (!step(i, false, &del_head)) return false;
+        }
+        for (uint8_t i = 0; i < ROLLOVER; i++) {
+            if (!step(i, true, &add)) return false;
+        }
+        for (uint8_t i = ROLLOVER; i--; ) {
+            if (!step(i, false, &del_tail)) return false;
+        }
+    }
+
+    printf("host %s: %u keys ns/call:", mode, ROLLOVER);
+    print_cost("add", &add);
+    print_cost("del head", &del_head);
+    print_cost("del tail", &del_tail);
+    printf("\n");
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long rounds = (argc > 1 ? strtoul(argv[1], NULL, 0) : 1);
+    if (!rounds) rounds = 1;
+
+    host_set_driver(&recorder);
+#ifdef NKRO_ENABLE
+    keyboard_nkro = true;
+    if (!bench("NKRO", rounds)) return 1;
+    keyboard_nkro = false;
+    if (!bench("NKRO off", rounds)) return 1;
+#else
+    if (!bench("6KRO", rounds)) return 1;
+#endif
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Replays iWRAP transcript on connection manager(protocol/iwrap/iwrap_link.c)
+ * and prints commands sent to iWRAP and changes of connection state.
+ *
+ *   $ iwrap transcript/iwrap5_pairing.txt
+ *
+ * Transcript is list of "<ms> <line from iWRAP>" lines, "<ms>" alone only
+ * runs until that time. "<ms> !pause" and "<ms> !resume" take iWRAP out of
+ * host outputs and back. '#' starts comment.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "timer.h"
+#include "iwrap.h"
+#include "iwrap_link.h"
+#include "test_host.h"
+
+
+static void print_escaped(const char *s)
+{
+    for (; *s; s++) {
+        if (*s == '\r') printf("\\r");
+        else if (*s == '\n') printf("\\n");
+        else putchar(*s);
+    }
+}
+
+/* iwrap.c replacement: commands are printed instead of sent on suart */
+void iwrap_send(const char *s)
+{
+    printf("%lu send ", (unsigned long)test_time);
+    print_escaped(s);
+    printf("\n");
+}
+
+void iwrap_mux_send(const char *s)
+{
+    printf("%lu mux ", (unsigned long)test_time);
+    print_escaped(s);
+    printf("\n");
+}
+
+
+static const char *state_name[] = {
+    [IWRAP_RESET] = "RESET",
+    [IWRAP_MUX] = "MUX",
+    [IWRAP_IDLE] = "IDLE",
+    [IWRAP_PAIR] = "PAIR",
+    [IWRAP_CALLING] = "CALLING",
+    [IWRAP_CONNECTED] = "CONNECTED",
+};
+
+static void print_state(const char *prefix)
+{
+    printf("%s state %s backoff %u link %c peer %s%s\n", prefix,
+           state_name[iwrap_link_state()], iwrap_link_backoff(), iwrap_link_id(),
+           iwrap_link_peer()[0] ? iwrap_link_peer() : "-",
+           iwrap_failed() ? " failed" : "");
+}
+
+/* prints state when anything of it changes */
+static void check_state(void)
+{
+    static iwrap_state_t state;
+    static uint16_t backoff;
+    static char link_id;
+    static char peer[BDADDR_LEN + 1];
+    static bool failed;
+    static bool valid = false;
+
+    if (valid && state == iwrap_link_state() && backoff == iwrap_link_backoff() &&
+            link_id == iwrap_link_id() && !strcmp(peer, iwrap_link_peer()) &&
+            failed == iwrap_failed())
+        return;
+
+    state = iwrap_link_state();
+    backoff = iwrap_link_backoff();
+    link_id = iwrap_link_id();
+    strcpy(peer, iwrap_link_peer());
+    failed = iwrap_failed();
+    valid = true;
+
+    char t[16];
+    snprintf(t, sizeof(t), "%lu", (unsigned long)test_time);
+    print_state(t);
+}
+
+int main(int argc, char **argv)
+{
+    char line[256];
+    unsigned long n = 0;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s transcript\n", argv[0]);
+        return 2;
+    }
+    FILE *f = fopen(argv[1], "r");
+    if (!f) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    iwrap_link_init();
+    check_state();
+    while (fgets(line, sizeof(line), f)) {
+        char *p = line;
+        char *end;
+        n++;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\0') continue;
+
+        unsigned long time = strtoul(p, &end, 10);
+        if (end == p || time < test_time) {
+            fprintf(stderr, "%s:%lu: bad time\n", argv[1], n);
+            return 1;
+        }
+        for (; test_time < time; test_time++) {
+            iwrap_link_task();
+            check_state();
+        }
+
+        p = end;
+        while (*p == ' ') p++;
+        p[strcspn(p, "\r\n")] = '\0';
+        if (!strcmp(p, "!pause") || !strcmp(p, "!resume")) {
+            printf("%lu %s\n", (unsigned long)test_time, p + 1);
+            iwrap_link_pause(p[1] == 'p');
+            check_state();
+        } else if (*p) {
+            // iwrap.c keeps only head of long line
+            if (strlen(p) > IWRAP_LINE_SIZE - 1) p[IWRAP_LINE_SIZE - 1] = '\0';
+            printf("%lu recv %s\n", (unsigned long)test_time, p);
+            iwrap_link_parse(p);
+            check_state();
+        }
+    }
+    fclose(f);
+    print_state("end");
+    return 0;
+}
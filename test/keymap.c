@@ -0,0 +1,79 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include "keycode.h"
+#include "action.h"
+#include "action_macro.h"
+#include "progmem.h"
+#include "keymap.h"
+
+
+/* Keymap of corpus scripts
+ *
+ * row 0:  A     B     C     D     E     LSFT  Fn0   Fn1
+ * row 1:  Fn2   Fn3   Fn4   Fn5   Fn6   F     G     ENT
+ */
+static const uint8_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
+    {
+        { KC_A,   KC_B,   KC_C,   KC_D,   KC_E,   KC_LSFT, KC_FN0, KC_FN1 },
+        { KC_FN2, KC_FN3, KC_FN4, KC_FN5, KC_FN6, KC_F,    KC_G,   KC_ENT },
+    },
+    {
+        { KC_1,   KC_2,   KC_3,   KC_4,   KC_5,   KC_TRNS, KC_TRNS, KC_TRNS },
+        { KC_TRNS,KC_TRNS,KC_TRNS,KC_TRNS,KC_TRNS,KC_LEFT, KC_RGHT, KC_TRNS },
+    },
+};
+
+static const uint16_t PROGMEM fn_actions[] = {
+    [0] = ACTION_LAYER_TAP_KEY(1, KC_SPC),
+    [1] = ACTION_MODS_TAP_KEY(MOD_LCTL, KC_ESC),
+    [2] = ACTION_MODS_ONESHOT(MOD_LSFT),
+    [3] = ACTION_LAYER_MOMENTARY(1),
+    [4] = ACTION_LAYER_TAP_TOGGLE(1),
+    [5] = ACTION_MODS_KEY(MOD_LSFT, KC_1),
+    [6] = ACTION_MACRO(0),
+};
+
+#define KEYMAPS_SIZE    (sizeof(keymaps) / sizeof(keymaps[0]))
+#define FN_ACTIONS_SIZE (sizeof(fn_actions) / sizeof(fn_actions[0]))
+
+uint8_t keymap_key_to_keycode(uint8_t layer, key_t key)
+{
+    if (layer >= KEYMAPS_SIZE) layer = 0;
+    return pgm_read_byte(&keymaps[layer][key.row][key.col]);
+}
+
+action_t keymap_fn_to_action(uint8_t keycode)
+{
+    action_t action;
+    if (FN_INDEX(keycode) < FN_ACTIONS_SIZE) {
+        action.code = pgm_read_word(&fn_actions[FN_INDEX(keycode)]);
+    } else {
+        action.code = ACTION_NO;
+    }
+    return action;
+}
+
+const macro_t *action_get_macro(keyrecord_t *record, uint8_t id, uint8_t opt)
+{
+    if (id == 0 && record->event.pressed) {
+        return MACRO( I(10), T(H), T(I), W(50), D(LSFT), T(1), U(LSFT),
+                      REPEAT(0), T(A), REPEAT_END,
+                      MODS_SEQ(MOD_BIT(KC_LCTL), KC_B, KC_B), END );
+    }
+    return MACRO_NONE;
+}
@@ -0,0 +1,172 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Replays key event script on action engine and prints reports sent to host.
+ *
+ *   $ replay corpus/tapping.txt            # report stream to stdout
+ *   $ replay -b 1000 corpus/a.txt corpus/b.txt  # per-event cost to stderr
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "keyboard.h"
+#include "action.h"
+#include "action_layer.h"
+#include "action_macro.h"
+#include "host.h"
+#include "host_driver.h"
+#include "test_host.h"
+
+
+/* time to run after last event so that taps and macros settle */
+#define SETTLE_TIME     1000
+#define MAX_EVENTS      4096
+
+static bool quiet = false;
+
+
+static uint8_t keyboard_leds(void) { return 0; }
+
+static void send_keyboard(report_keyboard_t *report)
+{
+    if (quiet) return;
+    printf("%lu keyboard", (unsigned long)test_time);
+    for (uint8_t i = 0; i < REPORT_SIZE; i++) {
+        printf(" %02X", report->raw[i]);
+    }
+    printf("\n");
+}
+
+static void send_mouse(report_mouse_t *report)
+{
+    if (quiet) return;
+    printf("%lu mouse %02X %d %d %d %d\n", (unsigned long)test_time,
+           report->buttons, report->x, report->y, report->v, report->h);
+}
+
+static void send_system(uint16_t data)
+{
+    if (quiet) return;
+    printf("%lu system %04X\n", (unsigned long)test_time, data);
+}
+
+static void send_consumer(uint16_t data)
+{
+    if (quiet) return;
+    printf("%lu consumer %04X\n", (unsigned long)test_time, data);
+}
+
+static host_driver_t recorder = {
+    keyboard_leds,
+    send_keyboard,
+    send_mouse,
+    send_system,
+    send_consumer
+};
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+typedef struct {
+    uint64_t event_ns, event_max, tick_ns;
+    unsigned long events, ticks;
+} cost_t;
+
+/* runs script scan by scan, one event per scan and a TICK scan every ms */
+static void run(const test_event_t *events, int n, cost_t *cost)
+{
+    uint32_t end = (n ? events[n - 1].time : 0) + SETTLE_TIME;
+    int i = 0;
+
+    for (test_time = 0; test_time <= end; test_time++) {
+        for (; i < n && events[i].time <= test_time; i++) {
+            uint64_t t = now_ns();
+            test_task(events[i].event);
+            t = now_ns() - t;
+            cost->event_ns += t;
+            if (t > cost->event_max) cost->event_max = t;
+            cost->events++;
+        }
+        uint64_t t = now_ns();
+        test_task(NOEVENT);
+        cost->tick_ns += now_ns() - t;
+        cost->ticks++;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static test_event_t events[MAX_EVENTS];
+    unsigned long repeat = 0;
+    int status = 0;
+    int i = 1;
+
+    if (i + 1 < argc && strcmp(argv[i], "-b") == 0) {
+        repeat = strtoul(argv[i + 1], NULL, 0);
+        quiet = true;
+        i += 2;
+    }
+    if (i == argc) {
+        fprintf(stderr, "usage: %s [-b repeat] script...\n", argv[0]);
+        return 2;
+    }
+
+    host_set_driver(&recorder);
+    for (; i < argc; i++) {
+        FILE *f = fopen(argv[i], "r");
+        if (!f) {
+            perror(argv[i]);
+            status = 1;
+            continue;
+        }
+        int n = test_read_script(f, events, MAX_EVENTS);
+        fclose(f);
+        if (n < 0) {
+            fprintf(stderr, "%s: parse error\n", argv[i]);
+            status = 1;
+            continue;
+        }
+
+        cost_t cost = {};
+        unsigned long r = 0;
+        do {
+            run(events, n, &cost);
+        } while (++r < repeat);
+
+        if (repeat) {
+            fprintf(stderr, "%s: %lu events %lu ns/event (max %lu), %lu ns/tick\n", argv[i],
+                    cost.events / r,
+                    (unsigned long)(cost.events ? cost.event_ns / cost.events : 0),
+                    (unsigned long)cost.event_max,
+                    (unsigned long)(cost.ticks ? cost.tick_ns / cost.ticks : 0));
+        } else {
+            printf("end layer %08lX mods %02X keys %u suppressed %u macro_dropped %u\n",
+                   (unsigned long)layer_state, host_get_mods(), host_has_anykey(),
+                   host_keyboard_suppressed(), action_macro_dropped());
+        }
+    }
+    return status;
+}
@@ -0,0 +1,69 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "timer.h"
+#include "action.h"
+#include "action_macro.h"
+#include "host.h"
+#include "test_host.h"
+
+
+void test_task(keyevent_t event)
+{
+    timer_count = test_time;
+    if (IS_NOEVENT(event)) {
+        action_exec(TICK);
+    } else {
+        event.time = timer_read() | 1;
+        action_exec(event);
+    }
+    action_macro_task();
+    host_flush_keyboard_report();
+}
+
+int test_read_script(FILE *f, test_event_t *events, int max)
+{
+    char line[128];
+    int n = 0;
+    unsigned long time;
+    unsigned row, col;
+    char dir;
+
+    while (fgets(line, sizeof(line), f)) {
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\0') continue;
+
+        if (sscanf(p, "%lu %u %u %c", &time, &row, &col, &dir) != 4 ||
+                row >= MATRIX_ROWS || col >= MATRIX_COLS ||
+                (dir != 'd' && dir != 'u') ||
+                (n && time < events[n - 1].time) || n == max) {
+            fprintf(stderr, "bad line: %s", line);
+            return -1;
+        }
+        events[n].time = time;
+        events[n].event = (keyevent_t){
+            .key = (key_t){ .row = row, .col = col },
+            .pressed = (dir == 'd'),
+            .time = 1
+        };
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,46 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TEST_HOST_H
+#define TEST_HOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "keyboard.h"
+
+
+/* Simulated keyboard for host build of action engine
+ *
+ * Time is counted in milli-seconds by test_time and advanced only by callers,
+ * timer_read() of common code returns it. test_task() does what
+ * keyboard_task() does for one matrix scan.
+ */
+extern uint32_t test_time;
+
+/* one scan: `event` or TICK if it is NOEVENT, then macro and report flush */
+void test_task(keyevent_t event);
+
+/* Script is list of lines "<ms> <row> <col> <d|u>", '#' starts comment.
+ * Returns number of events read or -1 on error. */
+typedef struct {
+    uint32_t time;
+    keyevent_t event;
+} test_event_t;
+
+int test_read_script(FILE *f, test_event_t *events, int max);
+
+#endif
@@ -0,0 +1,43 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include "timer.h"
+#include "test_host.h"
+
+
+/* timer.c replacement, time is advanced by test */
+uint32_t test_time = 0;
+volatile uint32_t timer_count = 0;
+
+
+void timer_init(void) {}
+void timer_clear(void) { test_time = 0; }
+uint16_t timer_read(void) { return test_time & 0xFFFF; }
+uint32_t timer_read32(void) { return test_time; }
+
+uint16_t timer_elapsed(uint16_t last)
+{
+    uint16_t t = timer_read();
+    return TIMER_DIFF_16(t, last);
+}
+
+uint32_t timer_elapsed32(uint32_t last)
+{
+    return TIMER_DIFF_32(test_time, last);
+}
+
+
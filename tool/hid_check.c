@@ -0,0 +1,189 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Parses report descriptors of common/report_descriptor.h on host and checks
+ * them against report structs. Run with `make hid_check` in keyboard directory,
+ * or by hand:
+ *
+ *   $ cc -Icommon -DNKRO_ENABLE -o hid_check tool/hid_check.c && ./hid_check
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "report.h"
+#include "report_descriptor.h"
+
+
+static int errors = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("%s: ", name); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        errors++; \
+    } \
+} while (0)
+
+/* returns size in bytes of input report `id`, including report ID byte */
+static unsigned input_size(const char *name, const uint8_t *d, unsigned len,
+                           uint8_t id, unsigned *output_bits)
+{
+    unsigned size = 0, count = 0, bits = 0, out = 0;
+    uint8_t cur_id = 0;
+    int depth = 0;
+
+    for (unsigned i = 0; i < len; ) {
+        uint8_t prefix = d[i++];
+        unsigned n = prefix & 0x03;
+        if (n == 3) n = 4;
+        CHECK(prefix != 0xFE, "long item at %u", i - 1);
+        CHECK(i + n <= len, "item at %u runs past end", i - 1);
+        if (i + n > len) break;
+
+        uint32_t v = 0;
+        for (unsigned k = 0; k < n; k++) v |= (uint32_t)d[i + k] << (8 * k);
+        i += n;
+
+        switch (prefix & 0xFC) {
+            case 0x74: size = v; break;                 // Report Size
+            case 0x94: count = v; break;                // Report Count
+            case 0x84:                                  // Report ID
+                CHECK(v != 0, "report ID 0");
+                cur_id = v;
+                break;
+            case 0x80:                                  // Input
+                if (cur_id == id) bits += size * count;
+                break;
+            case 0x90:                                  // Output
+                if (cur_id == id) out += size * count;
+                break;
+            case 0xA0: depth++; break;                  // Collection
+            case 0xC0:                                  // End Collection
+                depth--;
+                CHECK(depth >= 0, "unbalanced End Collection");
+                break;
+        }
+    }
+    CHECK(depth == 0, "collection not closed");
+    CHECK(bits % 8 == 0, "input report %u is %u bits", id, bits);
+    if (output_bits) *output_bits = out;
+    return bits / 8 + (id ? 1 : 0);
+}
+
+#define SIZE(d, id, out)    input_size(name, d, sizeof(d), id, out)
+
+/* descriptors as protocol stacks compile them */
+static const uint8_t lufa_keyboard[] = { RD_LUFA_KEYBOARD };
+static const uint8_t lufa_mouse[] = { RD_LUFA_MOUSE };
+static const uint8_t lufa_extrakey[] = { RD_LUFA_EXTRAKEY };
+static const uint8_t pjrc_keyboard[] = { RD_PJRC_KEYBOARD };
+static const uint8_t pjrc_mouse[] = { RD_PJRC_MOUSE };
+static const uint8_t pjrc_extrakey[] = { RD_PJRC_EXTRAKEY };
+#ifdef NKRO_ENABLE
+static const uint8_t lufa_nkro[] = { RD_LUFA_NKRO };
+static const uint8_t pjrc_nkro[] = { RD_PJRC_NKRO };
+#endif
+static const uint8_t vusb_keyboard[] = { RD_VUSB_KEYBOARD };
+static const uint8_t vusb_ep3[] = { RD_VUSB_EP3 };
+
+/* boot keyboard is sent from head of report_keyboard_t */
+static void check_keyboard(const char *name, const uint8_t *d, unsigned len, unsigned epsize)
+{
+    unsigned out;
+    unsigned size = input_size(name, d, len, 0, &out);
+    CHECK(size == RD_KEYBOARD_SIZE, "%u bytes", size);
+    CHECK(size == epsize, "%u bytes, endpoint %u", size, epsize);
+    CHECK(out == 8, "LED report %u bits", out);
+}
+#define KEYBOARD(d, epsize)     check_keyboard(#d, d, sizeof(d), epsize)
+
+#ifdef NKRO_ENABLE
+static void check_nkro(const char *name, const uint8_t *d, unsigned len, unsigned epsize)
+{
+    unsigned out;
+    unsigned size = input_size(name, d, len, 0, &out);
+    CHECK(size == sizeof(report_keyboard_t),
+          "%u bytes, report_keyboard_t %zu", size, sizeof(report_keyboard_t));
+    CHECK(size == epsize, "%u bytes, endpoint %u", size, epsize);
+    CHECK(out == 8, "LED report %u bits", out);
+}
+#define NKRO(d, epsize)         check_nkro(#d, d, sizeof(d), epsize)
+#endif
+
+int main(void)
+{
+    const char *name;
+
+    CHECK(sizeof(report_keyboard_t) >= RD_KEYBOARD_SIZE,
+          "report_keyboard_t %zu", sizeof(report_keyboard_t));
+
+    KEYBOARD(lufa_keyboard, RD_LUFA_KEYBOARD_EPSIZE);
+    KEYBOARD(pjrc_keyboard, RD_PJRC_KBD_SIZE);
+    KEYBOARD(vusb_keyboard, RD_VUSB_KEYBOARD_SIZE);
+#ifdef NKRO_ENABLE
+    NKRO(lufa_nkro, RD_LUFA_NKRO_EPSIZE);
+    NKRO(pjrc_nkro, RD_PJRC_KBD2_SIZE);
+#endif
+
+    name = "lufa_mouse";
+    CHECK(SIZE(lufa_mouse, 0, 0) == sizeof(report_mouse_t),
+          "%u bytes, report_mouse_t %zu", SIZE(lufa_mouse, 0, 0), sizeof(report_mouse_t));
+    name = "pjrc_mouse";
+    CHECK(SIZE(pjrc_mouse, 0, 0) == sizeof(report_mouse_t),
+          "%u bytes, report_mouse_t %zu", SIZE(pjrc_mouse, 0, 0), sizeof(report_mouse_t));
+
+    name = "lufa_extrakey";
+    CHECK(SIZE(lufa_extrakey, REPORT_ID_SYSTEM, 0) == 1 + RD_EXTRA_SIZE,
+          "system %u bytes", SIZE(lufa_extrakey, REPORT_ID_SYSTEM, 0));
+    CHECK(SIZE(lufa_extrakey, REPORT_ID_CONSUMER, 0) == 1 + RD_EXTRA_SIZE,
+          "consumer %u bytes", SIZE(lufa_extrakey, REPORT_ID_CONSUMER, 0));
+    name = "pjrc_extrakey";
+    CHECK(SIZE(pjrc_extrakey, REPORT_ID_SYSTEM, 0) == 1 + RD_EXTRA_SIZE,
+          "system %u bytes", SIZE(pjrc_extrakey, REPORT_ID_SYSTEM, 0));
+    CHECK(SIZE(pjrc_extrakey, REPORT_ID_CONSUMER, 0) == 1 + RD_EXTRA_SIZE,
+          "consumer %u bytes", SIZE(pjrc_extrakey, REPORT_ID_CONSUMER, 0));
+
+    // reports of EP3 as build options leave them, absent ones are only ID byte
+    name = "vusb_ep3";
+#if defined(MOUSE_ENABLE) || !(defined(EXTRAKEY_ENABLE) || defined(NKRO_ENABLE))
+    CHECK(SIZE(vusb_ep3, REPORT_ID_MOUSE, 0) == 1 + sizeof(report_mouse_t),
+          "mouse %u bytes", SIZE(vusb_ep3, REPORT_ID_MOUSE, 0));
+#else
+    CHECK(SIZE(vusb_ep3, REPORT_ID_MOUSE, 0) == 1, "mouse not left out");
+#endif
+#ifdef EXTRAKEY_ENABLE
+    CHECK(SIZE(vusb_ep3, REPORT_ID_SYSTEM, 0) == 1 + RD_EXTRA_SIZE,
+          "system %u bytes", SIZE(vusb_ep3, REPORT_ID_SYSTEM, 0));
+    CHECK(SIZE(vusb_ep3, REPORT_ID_CONSUMER, 0) == 1 + RD_EXTRA_SIZE,
+          "consumer %u bytes", SIZE(vusb_ep3, REPORT_ID_CONSUMER, 0));
+#else
+    CHECK(SIZE(vusb_ep3, REPORT_ID_SYSTEM, 0) == 1, "system not left out");
+#endif
+#ifdef NKRO_ENABLE
+    {
+        unsigned out;
+        CHECK(SIZE(vusb_ep3, REPORT_ID_NKRO, &out) == 1 + sizeof(report_keyboard_t),
+              "nkro %u bytes", SIZE(vusb_ep3, REPORT_ID_NKRO, 0));
+        CHECK(out == 0, "nkro LED report %u bits, LEDs come to boot keyboard", out);
+    }
+#endif
+
+    printf("hid_check: %s\n", errors ? "FAILED" : "OK");
+    return errors ? 1 : 0;
+}
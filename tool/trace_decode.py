@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+#
+# Decode binary trace records from console output.
+#
+# Firmware built with TRACE_ENABLE sends trace records as lines of "#T"
+# followed by 16 hex digits: format string ID, timestamp and two arguments.
+# ID is offset of the format string in section .trace_fmt of the ELF file.
+# Other lines are passed through as is.
+#
+# Usage:
+#   hid_listen | python3 trace_decode.py keyboard.elf
+#   python3 trace_decode.py keyboard.elf console.log
+#
+import re
+import struct
+import sys
+
+
+def read_section(path, name):
+    with open(path, 'rb') as f:
+        elf = f.read()
+    if elf[:4] != b'\x7fELF':
+        sys.exit('%s: not an ELF file' % path)
+    is64 = elf[4] == 2
+    end = '<' if elf[5] == 1 else '>'
+    if is64:
+        shoff, = struct.unpack_from(end + 'Q', elf, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from(end + 'HHH', elf, 0x3A)
+        shfmt = end + 'IIQQQQIIQQ'
+    else:
+        shoff, = struct.unpack_from(end + 'I', elf, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(end + 'HHH', elf, 0x2E)
+        shfmt = end + 'IIIIIIIIII'
+
+    sections = [struct.unpack_from(shfmt, elf, shoff + i * shentsize)
+                for i in range(shnum)]
+    strtab = sections[shstrndx]
+    for sh in sections:
+        n = elf[strtab[4] + sh[0]:].split(b'\0', 1)[0].decode()
+        if n == name:
+            return elf[sh[4]:sh[4] + sh[5]]
+    sys.exit('%s: no section %s, built without TRACE_ENABLE?' % (path, name))
+
+
+SPEC = re.compile(r'%([-+ #0]*\d*)([diouxXcb%])')
+
+def format_record(fmt, args):
+    args = list(args)
+
+    def conv(m):
+        flags, c = m.groups()
+        if c == '%':
+            return '%'
+        v = args.pop(0) if args else 0
+        if c in 'di':
+            v = v - 0x10000 if v & 0x8000 else v
+            c = 'd'
+        elif c == 'u':
+            c = 'd'
+        elif c == 'b':
+            return format(v, (flags or '') + 'b')
+        return ('%' + flags + c) % v
+
+    return SPEC.sub(conv, fmt)
+
+
+RECORD = re.compile(r'#T([0-9A-Fa-f]{16})$')
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit('usage: %s keyboard.elf [console.log]' % sys.argv[0])
+    fmts = read_section(sys.argv[1], '.trace_fmt')
+    src = open(sys.argv[2]) if len(sys.argv) > 2 else sys.stdin
+
+    for line in src:
+        line = line.rstrip('\r\n')
+        m = RECORD.search(line)
+        if not m:
+            print(line)
+            continue
+        id, time, a0, a1 = (int(m.group(1)[i:i + 4], 16) for i in range(0, 16, 4))
+        if id >= len(fmts):
+            print('%s[unknown trace id %04X]' % (line[:m.start()], id))
+            continue
+        fmt = fmts[id:].split(b'\0', 1)[0].decode(errors='replace')
+        print('%s%5u: %s' % (line[:m.start()], time, format_record(fmt, (a0, a1))))
+        sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    main()